@@ -0,0 +1,215 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "log_message.h"
+#include "log_message_handler.h"
+
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(std::size_t capacity)
+    : mask_(roundUpToPowerOfTwo(capacity) - 1), cells_(mask_ + 1) {
+        for (std::size_t i = 0; i < cells_.size(); ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(T&& value) {
+        std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value.emplace(std::move(value));
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    // Safe to call from producers as well as the consumer, which is what lets
+    // a producer evict the oldest entry when the ring is full.
+    std::optional<T> tryPop() {
+        std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    std::optional<T> value = std::move(cell.value);
+                    cell.value.reset();
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return value;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    // Positions claimed by pushes and by pops so far; both only grow.
+    std::size_t enqueuePosition() const {
+        return enqueue_pos_.load();
+    }
+    std::size_t dequeuePosition() const {
+        return dequeue_pos_.load();
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence{0};
+        std::optional<T> value;
+    };
+
+    static std::size_t roundUpToPowerOfTwo(std::size_t n) {
+        std::size_t result = 2;
+        while (result < n) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    std::size_t mask_;
+    std::vector<Cell> cells_;
+    alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<std::size_t> dequeue_pos_{0};
+};
+
+enum class BackpressurePolicy {
+    Block,
+    DropNewest,
+    DropOldest
+};
+
+// Moves handler execution off the calling thread: submit() only enqueues into
+// a bounded lock-free ring and a single background thread drains it into the
+// chain. Exceptions thrown by the chain are passed to on_error, which runs on
+// the background thread.
+class AsyncLogger {
+public:
+    struct Stats {
+        std::uint64_t submitted = 0;
+        std::uint64_t processed = 0;
+        std::uint64_t failed = 0;
+        std::uint64_t dropped_newest = 0;
+        std::uint64_t dropped_oldest = 0;
+    };
+    using ErrorCallback = std::function<void(const LogMessage&, const std::exception&)>;
+
+    AsyncLogger(LogMessageHandler& chain, std::size_t capacity,
+                BackpressurePolicy policy = BackpressurePolicy::Block, ErrorCallback on_error = nullptr)
+    : chain_(chain), policy_(policy), ring_(capacity), on_error_(std::move(on_error)),
+      consumer_([this] { run(); }) {
+    }
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+    ~AsyncLogger() {
+        stop_.store(true, std::memory_order_release);
+        consumer_.join();
+    }
+
+    // Returns false if the message was dropped under DropNewest.
+    bool submit(LogMessage log) {
+        while (!ring_.tryPush(std::move(log))) {
+            switch (policy_) {
+            case BackpressurePolicy::Block:
+                std::this_thread::yield();
+                break;
+            case BackpressurePolicy::DropNewest:
+                dropped_newest_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            case BackpressurePolicy::DropOldest:
+                if (ring_.tryPop()) {
+                    dropped_oldest_.fetch_add(1, std::memory_order_relaxed);
+                }
+                break;
+            }
+        }
+        submitted_.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+    // Waits until everything submitted before the call has been handled or
+    // dropped. Counts ring positions rather than submit() calls, so a message
+    // another producer has claimed a slot for is waited for as well.
+    void flush() const {
+        std::size_t target = ring_.enqueuePosition();
+        while (consumed_.load() < target) {
+            std::this_thread::yield();
+        }
+    }
+    Stats stats() const {
+        Stats stats;
+        stats.submitted = submitted_.load(std::memory_order_relaxed);
+        stats.processed = processed_.load(std::memory_order_relaxed);
+        stats.failed = failed_.load(std::memory_order_relaxed);
+        stats.dropped_newest = dropped_newest_.load(std::memory_order_relaxed);
+        stats.dropped_oldest = dropped_oldest_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    LogMessageHandler& chain_;
+    BackpressurePolicy policy_;
+    MpscRing<LogMessage> ring_;
+    ErrorCallback on_error_;
+    std::atomic<bool> stop_{false};
+    // Every position below it has been popped, and handled if the consumer
+    // popped it; the consumer sets it before each pop.
+    std::atomic<std::size_t> consumed_{0};
+    std::atomic<std::uint64_t> submitted_{0};
+    std::atomic<std::uint64_t> processed_{0};
+    std::atomic<std::uint64_t> failed_{0};
+    std::atomic<std::uint64_t> dropped_newest_{0};
+    std::atomic<std::uint64_t> dropped_oldest_{0};
+    std::thread consumer_;
+
+    void run() {
+        unsigned idle_spins = 0;
+        for (;;) {
+            consumed_.store(ring_.dequeuePosition());
+            std::optional<LogMessage> log = ring_.tryPop();
+            if (!log && stop_.load(std::memory_order_acquire)) {
+                log = ring_.tryPop();
+                if (!log) {
+                    return;
+                }
+            }
+            if (!log) {
+                if (++idle_spins < 64) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                continue;
+            }
+            idle_spins = 0;
+            try {
+                chain_.handle(*log);
+                processed_.fetch_add(1, std::memory_order_release);
+            } catch (const std::exception& e) {
+                if (on_error_) {
+                    on_error_(*log, e);
+                }
+                failed_.fetch_add(1, std::memory_order_release);
+            }
+        }
+    }
+};
@@ -0,0 +1,815 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binary_log.h"
+#include "durable_error_handler.h"
+#include "handler_chain.h"
+#include "log_handlers.h"
+#include "mmap_error_handler.h"
+#include "rate_limit_handlers.h"
+#include "static_chain.h"
+#include "swappable_chain.h"
+
+namespace {
+
+std::atomic<std::uint64_t> g_allocations{0};
+thread_local std::size_t g_consumed = 0;
+
+}  // namespace
+
+// Every allocation is counted, aligned ones included (the chain arena, the
+// per-thread reader slots). Kept out of line so GCC does not pair the inlined
+// malloc/free with new/delete and warn about a mismatch.
+[[gnu::noinline]] void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void* operator new(std::size_t size, std::align_val_t align) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = nullptr;
+    std::size_t alignment = std::max(static_cast<std::size_t>(align), sizeof(void*));
+    if (::posix_memalign(&p, alignment, size ? size : 1) == 0) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+[[gnu::noinline]] void* operator new[](std::size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <LogMessageType Type>
+class NullHandler final : public LogMessageHandler {
+public:
+    static constexpr LogMessageType kLogMessageType = Type;
+
+    NullHandler() : LogMessageHandler(kLogMessageType) {
+    }
+
+private:
+    void operate(const LogMessage& log) const override {
+        g_consumed += log.message().size();
+    }
+};
+
+const char* typeName(LogMessageType type) {
+    switch (type) {
+    case LogMessageType::Warning:
+        return "Warning";
+    case LogMessageType::Error:
+        return "Error";
+    case LogMessageType::FatalError:
+        return "FatalError";
+    case LogMessageType::UnknownMessage:
+        break;
+    }
+    return "UnknownMessage";
+}
+
+constexpr LogMessageType kAllTypes[] = {
+    LogMessageType::FatalError, LogMessageType::Error, LogMessageType::Warning, LogMessageType::UnknownMessage
+};
+
+std::unique_ptr<LogMessageHandler> makeNullHandler(LogMessageType type) {
+    switch (type) {
+    case LogMessageType::Warning:
+        return std::make_unique<NullHandler<LogMessageType::Warning>>();
+    case LogMessageType::Error:
+        return std::make_unique<NullHandler<LogMessageType::Error>>();
+    case LogMessageType::FatalError:
+        return std::make_unique<NullHandler<LogMessageType::FatalError>>();
+    case LogMessageType::UnknownMessage:
+        break;
+    }
+    return std::make_unique<NullHandler<LogMessageType::UnknownMessage>>();
+}
+
+HandlerChain::Builder& addNullHandler(HandlerChain::Builder& builder, LogMessageType type) {
+    switch (type) {
+    case LogMessageType::Warning:
+        return builder.add<NullHandler<LogMessageType::Warning>>();
+    case LogMessageType::Error:
+        return builder.add<NullHandler<LogMessageType::Error>>();
+    case LogMessageType::FatalError:
+        return builder.add<NullHandler<LogMessageType::FatalError>>();
+    case LogMessageType::UnknownMessage:
+        break;
+    }
+    return builder.add<NullHandler<LogMessageType::UnknownMessage>>();
+}
+
+// A chain of `length` null handlers where only the last one claims `target`,
+// so a message of that type walks the whole chain. Handlers are allocated one
+// by one, or together in a HandlerChain arena.
+class NullChain {
+public:
+    NullChain(std::size_t length, LogMessageType target, bool compiled, bool arena = false) {
+        std::vector<LogMessageType> types;
+        std::size_t filler = 0;
+        for (std::size_t i = 0; i + 1 < length; ++i) {
+            LogMessageType type = kAllTypes[filler++ % 4];
+            if (type == target) {
+                type = kAllTypes[filler++ % 4];
+            }
+            types.push_back(type);
+        }
+        types.push_back(target);
+        if (arena) {
+            HandlerChain::Builder builder;
+            for (LogMessageType type : types) {
+                addNullHandler(builder, type);
+            }
+            arena_.emplace(builder.build());
+            head_ = &arena_->head();
+        } else {
+            for (LogMessageType type : types) {
+                handlers_.push_back(makeNullHandler(type));
+            }
+            for (std::size_t i = 0; i + 1 < handlers_.size(); ++i) {
+                handlers_[i]->setNextHandler(handlers_[i + 1].get());
+            }
+            head_ = handlers_.front().get();
+        }
+        if (compiled) {
+            head_->compile();
+        }
+    }
+
+    LogMessageHandler& head() {
+        return *head_;
+    }
+
+private:
+    std::vector<std::unique_ptr<LogMessageHandler>> handlers_;
+    std::optional<HandlerChain> arena_;
+    LogMessageHandler* head_ = nullptr;
+};
+
+struct Result {
+    double ns_per_op = 0;
+    double mops_per_sec = 0;
+    double allocs_per_op = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+};
+
+// Runs `op` ops_per_thread times on each of `threads` threads, twice: an
+// untimed-per-op pass for throughput and allocation counts, then a pass that
+// times every op individually for the latency percentiles.
+Result measure(unsigned threads, std::size_t ops_per_thread, const std::function<void()>& op) {
+    for (std::size_t i = 0; i < std::min<std::size_t>(ops_per_thread, 1000); ++i) {
+        op();
+    }
+
+    std::vector<std::vector<std::uint32_t>> samples(threads, std::vector<std::uint32_t>(ops_per_thread));
+    auto runThreads = [&](const std::function<void(unsigned)>& body) {
+        std::atomic<bool> go{false};
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                while (!go.load(std::memory_order_acquire)) {
+                }
+                body(t);
+            });
+        }
+        auto start = Clock::now();
+        go.store(true, std::memory_order_release);
+        body(0);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    };
+
+    Result result;
+    std::uint64_t allocations_before = g_allocations.load();
+    double elapsed_ns = runThreads([&](unsigned) {
+        for (std::size_t i = 0; i < ops_per_thread; ++i) {
+            op();
+        }
+    });
+    std::uint64_t allocations = g_allocations.load() - allocations_before;
+    std::size_t total_ops = ops_per_thread * threads;
+    result.ns_per_op = elapsed_ns / static_cast<double>(ops_per_thread);
+    result.mops_per_sec = static_cast<double>(total_ops) * 1e3 / elapsed_ns;
+
+    runThreads([&](unsigned t) {
+        std::vector<std::uint32_t>& thread_samples = samples[t];
+        for (std::size_t i = 0; i < ops_per_thread; ++i) {
+            auto start = Clock::now();
+            op();
+            thread_samples[i] = static_cast<std::uint32_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        }
+    });
+    result.allocs_per_op = static_cast<double>(allocations) / static_cast<double>(total_ops);
+
+    std::vector<std::uint32_t> all;
+    all.reserve(total_ops);
+    for (const auto& thread_samples : samples) {
+        all.insert(all.end(), thread_samples.begin(), thread_samples.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double q) {
+        return static_cast<double>(all[std::min(all.size() - 1, static_cast<std::size_t>(q * all.size()))]);
+    };
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    result.p999 = percentile(0.999);
+    return result;
+}
+
+class Runner {
+public:
+    explicit Runner(std::string filter) : filter_(std::move(filter)) {
+        std::printf("%-52s %10s %10s %10s %8s %8s %8s\n",
+                    "Benchmark", "ns/op", "Mops/s", "allocs/op", "p50", "p99", "p999");
+        std::printf("%s\n", std::string(112, '-').c_str());
+    }
+
+    // When one op handles several messages, pass items_per_op so that every
+    // column is reported per message.
+    void run(const std::string& name, unsigned threads, std::size_t ops_per_thread,
+             const std::function<void()>& op, std::size_t items_per_op = 1) {
+        std::string full_name = name + "/threads:" + std::to_string(threads);
+        if (full_name.find(filter_) == std::string::npos) {
+            return;
+        }
+        Result r = measure(threads, ops_per_thread, op);
+        auto items = static_cast<double>(items_per_op);
+        r.ns_per_op /= items;
+        r.mops_per_sec *= items;
+        r.allocs_per_op /= items;
+        r.p50 /= items;
+        r.p99 /= items;
+        r.p999 /= items;
+        std::printf("%-52s %10.1f %10.2f %10.2f %8.0f %8.0f %8.0f\n",
+                    full_name.c_str(), r.ns_per_op, r.mops_per_sec, r.allocs_per_op, r.p50, r.p99, r.p999);
+        std::fflush(stdout);
+    }
+
+private:
+    std::string filter_;
+};
+
+template <typename Chain>
+void handleCatching(Chain& chain, const LogMessage& log) {
+    try {
+        chain.handle(log);
+    } catch (const std::runtime_error&) {
+    }
+}
+
+void benchMessages(Runner& runner) {
+    constexpr std::size_t kOps = 200000;
+    runner.run("message/literal", 1, kOps, [] {
+        LogMessage log(LogMessageType::Warning, "a warning long enough to defeat the small string optimization");
+        g_consumed += log.message().size();
+    });
+    runner.run("message/borrowed", 1, kOps, [] {
+        auto log = LogMessage::borrowed(LogMessageType::Warning, "a warning long enough to defeat the SSO");
+        g_consumed += log.message().size();
+    });
+    runner.run("message/formatted", 1, kOps, [] {
+        auto log = LogMessage::formatted(LogMessageType::Error, "request %d failed: %s", 42, "timeout");
+        g_consumed += log.message().size();
+    });
+    runner.run("message/formatted_3_args", 1, kOps, [] {
+        auto log = LogMessage::formatted(LogMessageType::Error, "write failed fd=%d bytes=%zu path=%s", 7,
+                                         std::size_t{4096}, "/var/log/app");
+        g_consumed += log.message().size();
+    });
+    runner.run("message/record_3_fields", 1, kOps, [] {
+        auto log = LogMessage::record(LogMessageType::Error, "write failed", LOG_SOURCE_LOCATION)
+                       .with("fd", 7)
+                       .with("bytes", std::size_t{4096})
+                       .with("path", "/var/log/app");
+        g_consumed += log.message().size();
+    });
+    runner.run("message/record_3_fields_rendered", 1, kOps, [] {
+        auto log = LogMessage::record(LogMessageType::Error, "write failed", LOG_SOURCE_LOCATION)
+                       .with("fd", 7)
+                       .with("bytes", std::size_t{4096})
+                       .with("path", "/var/log/app");
+        g_consumed += renderText(log).size();
+    });
+    runner.run("message/std_string", 1, kOps, [] {
+        LogMessage log(LogMessageType::Warning, std::string("a warning long enough to defeat the SSO"));
+        g_consumed += log.message().size();
+    });
+}
+
+void benchNullChains(Runner& runner) {
+    constexpr std::size_t kOps = 200000;
+    for (bool compiled : {false, true}) {
+        for (std::size_t length : {4, 16, 64, 256}) {
+            for (LogMessageType type : kAllTypes) {
+                NullChain chain(length, type, compiled);
+                auto log = LogMessage::borrowed(type, "message");
+                std::string name = std::string("dynamic/null/") + (compiled ? "compiled/" : "linked/")
+                    + typeName(type) + "/len:" + std::to_string(length);
+                runner.run(name, 1, kOps, [&] { chain.head().handle(log); });
+            }
+        }
+        NullChain chain(16, LogMessageType::UnknownMessage, compiled);
+        auto log = LogMessage::borrowed(LogMessageType::UnknownMessage, "message");
+        for (unsigned threads : {2, 4, 8}) {
+            std::string name = std::string("dynamic/null/") + (compiled ? "compiled/" : "linked/")
+                + "UnknownMessage/len:16";
+            runner.run(name, threads, kOps, [&] { chain.head().handle(log); });
+        }
+    }
+
+    StaticChain<NullHandler<LogMessageType::FatalError>, NullHandler<LogMessageType::Error>,
+                NullHandler<LogMessageType::Warning>, NullHandler<LogMessageType::UnknownMessage>> chain;
+    for (LogMessageType type : kAllTypes) {
+        auto log = LogMessage::borrowed(type, "message");
+        for (unsigned threads : {1, 4}) {
+            runner.run(std::string("static/null/") + typeName(type) + "/len:4", threads, kOps,
+                       [&] { chain.handle(log); });
+        }
+    }
+}
+
+class NullMultiTypeHandler final : public MultiTypeHandler {
+public:
+    using MultiTypeHandler::MultiTypeHandler;
+
+private:
+    void operate(const LogMessage& log) const override {
+        g_consumed += log.message().size();
+    }
+};
+
+// One handler per type against two multi-type handlers covering the same
+// types, plus the cost of a predicate that rejects every other message.
+void benchMultiType(Runner& runner) {
+    constexpr std::size_t kOps = 200000;
+    NullMultiTypeHandler low(logMessageTypeRange(LogMessageType::Warning, LogMessageType::Error));
+    NullMultiTypeHandler high(logMessageTypeRange(LogMessageType::FatalError, LogMessageType::UnknownMessage));
+    low.setNextHandler(&high);
+    NullMultiTypeHandler filtered(kAllLogMessageTypes);
+    filtered.setPredicate([](const LogMessage& log) { return log.message().size() % 2 == 0; });
+    filtered.setNextHandler(&low);
+    for (bool compiled : {false, true}) {
+        if (compiled) {
+            low.compile();
+            filtered.compile();
+        }
+        std::string mode = compiled ? "compiled/" : "linked/";
+        for (LogMessageType type : kAllTypes) {
+            auto even = LogMessage::borrowed(type, "message!");
+            auto odd = LogMessage::borrowed(type, "message");
+            runner.run("multi/null/" + mode + typeName(type) + "/len:2", 1, kOps, [&] { low.handle(even); });
+            runner.run("predicate/null/" + mode + typeName(type) + "/len:3", 1, kOps, [&] {
+                filtered.handle(even);
+                filtered.handle(odd);
+            }, 2);
+        }
+    }
+}
+
+// Fan-out over a 16-handler chain where every fourth handler claims the type.
+void benchBroadcast(Runner& runner) {
+    constexpr std::size_t kOps = 200000;
+    for (bool compiled : {false, true}) {
+        NullChain chain(16, LogMessageType::UnknownMessage, false);
+        chain.head().setBroadcast(true);
+        if (compiled) {
+            chain.head().compile();
+        }
+        for (LogMessageType type : kAllTypes) {
+            auto log = LogMessage::borrowed(type, "message");
+            runner.run(std::string("broadcast/null/") + (compiled ? "compiled/" : "linked/") + typeName(type)
+                       + "/len:16", 1, kOps, [&] { chain.head().handle(log); });
+        }
+    }
+}
+
+// A warning flood through a rate limiter or a dedup handler in front of a
+// null sink: "passed" messages reach the sink, "dropped" ones stop at the
+// limiter. Four threads share the per-type counters.
+void benchLimits(Runner& runner) {
+    constexpr std::size_t kOps = 200000;
+    NullHandler<LogMessageType::Warning> sink;
+    auto log = LogMessage::borrowed(LogMessageType::Warning, "disk almost full");
+    for (unsigned threads : {1, 4}) {
+        RateLimitHandler open(logMessageTypeMask(LogMessageType::Warning), 1e12, 1000000);
+        open.setNextHandler(&sink);
+        runner.run("ratelimit/null/passed", threads, kOps, [&] { open.handle(log); });
+        RateLimitHandler closed(logMessageTypeMask(LogMessageType::Warning), 10, 10);
+        closed.setNextHandler(&sink);
+        runner.run("ratelimit/null/dropped", threads, kOps, [&] { closed.handle(log); });
+
+        DedupHandler dedup(logMessageTypeMask(LogMessageType::Warning), std::chrono::seconds(10));
+        dedup.setNextHandler(&sink);
+        runner.run("dedup/null/repeated", threads, kOps, [&] { dedup.handle(log); });
+        auto other = LogMessage::borrowed(LogMessageType::Warning, "disk full");
+        runner.run("dedup/null/alternating", threads, kOps, [&] {
+            dedup.handle(log);
+            dedup.handle(other);
+        }, 2);
+        dedup.flush();
+    }
+}
+
+// Reader overhead of a SwappableChain over calling the head directly, then
+// the same while another thread swaps in a new chain every 100 us.
+void benchSwappable(Runner& runner) {
+    constexpr std::size_t kOps = 200000;
+    auto makeChain = [] {
+        HandlerChain::Builder builder;
+        for (LogMessageType type : kAllTypes) {
+            addNullHandler(builder, type);
+        }
+        HandlerChain chain = builder.build();
+        chain.compile();
+        return chain;
+    };
+    auto log = LogMessage::borrowed(LogMessageType::UnknownMessage, "message");
+    HandlerChain direct = makeChain();
+    SwappableChain swappable(makeChain());
+    for (unsigned threads : {1, 4}) {
+        runner.run("swap/null/direct/len:4", threads, kOps, [&] { direct.head().handle(log); });
+        runner.run("swap/null/swappable/len:4", threads, kOps, [&] { swappable.handle(log); });
+    }
+    std::atomic<bool> stop{false};
+    std::thread swapper([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            swappable.swap(makeChain());
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+    for (unsigned threads : {1, 4}) {
+        runner.run("swap/null/swapping/len:4", threads, kOps, [&] { swappable.handle(log); });
+    }
+    stop = true;
+    swapper.join();
+}
+
+// Warnings sent to a chain that only claims errors fall off the end: eager
+// formatting pays for text nobody reads, lazy formatting does not.
+void benchLazy(Runner& runner) {
+    constexpr std::size_t kOps = 200000;
+    NullHandler<LogMessageType::Error> errors_only;
+    runner.run("dropped/formatted", 1, kOps, [&] {
+        errors_only.handle(LogMessage::formatted(LogMessageType::Warning, "retry %d of %d for %s", 3, 5, "db-1"));
+    });
+    runner.run("dropped/lazy", 1, kOps, [&] {
+        errors_only.handle(LogMessage::lazy(LogMessageType::Warning, "retry {} of {} for {}", 3, 5, "db-1"));
+    });
+    // A claimed message is rendered by its sink, so both rows route and render.
+    runner.run("claimed/formatted", 1, kOps, [&] {
+        auto log = LogMessage::formatted(LogMessageType::Error, "retry %d of %d for %s", 3, 5, "db-1");
+        errors_only.handle(log);
+        g_consumed += renderText(log).size();
+    });
+    runner.run("claimed/lazy", 1, kOps, [&] {
+        auto log = LogMessage::lazy(LogMessageType::Error, "retry {} of {} for {}", 3, 5, "db-1");
+        errors_only.handle(log);
+        g_consumed += renderText(log).size();
+    });
+}
+
+// Reports per hop rather than per message, so flat numbers across lengths
+// mean traversal cost does not grow with depth beyond the hops themselves.
+void benchLongChains(Runner& runner) {
+    for (std::size_t length : {10, 1000, 100000}) {
+        for (bool arena : {false, true}) {
+            NullChain chain(length, LogMessageType::UnknownMessage, false, arena);
+            auto log = LogMessage::borrowed(LogMessageType::UnknownMessage, "message");
+            runner.run(std::string("hop/null/") + (arena ? "arena/" : "linked/") + "len:" + std::to_string(length), 1,
+                       std::max<std::size_t>(20, 2000000 / length), [&] { chain.head().handle(log); }, length);
+        }
+    }
+}
+
+void benchRealSinks(Runner& runner, const std::filesystem::path& error_path) {
+    constexpr std::size_t kOps = 20000;
+    {
+        FatalErrorHandler fatal_h;
+        ErrorHandler error_h(error_path);
+        WarningHandler warning_h;
+        UnknownMessageHandler unknown_h;
+        fatal_h.setNextHandler(&error_h);
+        error_h.setNextHandler(&warning_h);
+        warning_h.setNextHandler(&unknown_h);
+        for (bool compiled : {false, true}) {
+            if (compiled) {
+                fatal_h.compile();
+            }
+            for (LogMessageType type : kAllTypes) {
+                auto log = LogMessage::borrowed(type, "a message routed to a real sink");
+                std::string name = std::string("dynamic/real/") + (compiled ? "compiled/" : "linked/")
+                    + typeName(type);
+                for (unsigned threads : {1, 4}) {
+                    runner.run(name, threads, kOps, [&] { handleCatching(fatal_h, log); });
+                }
+                runner.run(std::string("nothrow/real/") + (compiled ? "compiled/" : "linked/") + typeName(type),
+                           1, kOps, [&] { fatal_h.tryHandle(log); });
+            }
+        }
+    }
+    StaticChain<FatalErrorHandler, ErrorHandler, WarningHandler, UnknownMessageHandler> chain(
+        std::tuple<>(), std::make_tuple(error_path), std::tuple<>(), std::tuple<>());
+    for (LogMessageType type : kAllTypes) {
+        auto log = LogMessage::borrowed(type, "a message routed to a real sink");
+        runner.run(std::string("static/real/") + typeName(type), 1, kOps, [&] { handleCatching(chain, log); });
+    }
+    {
+        std::filesystem::path ring_path = error_path;
+        ring_path += ".ring";
+        MmapErrorHandler mmap_h(ring_path);
+        auto log = LogMessage::borrowed(LogMessageType::Error, "a message routed to a real sink");
+        for (unsigned threads : {1, 4}) {
+            runner.run("mmap/real/Error", threads, kOps, [&] { mmap_h.handle(log); });
+        }
+        std::filesystem::remove(ring_path);
+    }
+    // A warning storm: one stderr write per line against the default buffered policy.
+    for (bool buffered : {false, true}) {
+        WarningHandler warning_h(buffered ? FlushPolicy::interactive() : FlushPolicy::perMessage());
+        auto log = LogMessage::borrowed(LogMessageType::Warning, "a message routed to a real sink");
+        for (unsigned threads : {1, 4}) {
+            runner.run(std::string("stderr/real/") + (buffered ? "buffered" : "per_message"), threads, kOps,
+                       [&] { warning_h.handle(log); });
+        }
+    }
+}
+
+void benchBatches(Runner& runner, const std::filesystem::path& error_path) {
+    constexpr std::size_t kBatch = 64;
+    FatalErrorHandler fatal_h;
+    ErrorHandler error_h(error_path);
+    WarningHandler warning_h;
+    fatal_h.setNextHandler(&error_h);
+    error_h.setNextHandler(&warning_h);
+    fatal_h.compile();
+    for (LogMessageType type : {LogMessageType::Error, LogMessageType::Warning}) {
+        std::vector<LogMessage> batch;
+        for (std::size_t i = 0; i < kBatch; ++i) {
+            batch.push_back(LogMessage::borrowed(type, "a message routed to a real sink"));
+        }
+        runner.run(std::string("single/real/") + typeName(type) + "/x64", 1, 2000, [&] {
+            for (const LogMessage& log : batch) {
+                fatal_h.handle(log);
+            }
+        }, kBatch);
+        runner.run(std::string("batch/real/") + typeName(type) + "/x64", 1, 2000, [&] {
+            fatal_h.handle(batch);
+        }, kBatch);
+    }
+}
+
+// Errors written out every 4 KiB through a blocking write and through
+// io_uring. The row is named after the backend actually in use.
+void benchFileBackends(Runner& runner, const std::filesystem::path& error_path) {
+    constexpr std::size_t kOps = 200000;
+    FlushPolicy policy;
+    policy.max_buffered_bytes = 4096;
+    for (FileBackend backend : {FileBackend::Stream, FileBackend::IoUring}) {
+        ErrorHandler error_h(error_path, policy, {}, backend);
+        std::string name = error_h.backend() == FileBackend::IoUring ? "io_uring" : "stream";
+        if (backend == FileBackend::IoUring && error_h.backend() != backend) {
+            name += "_fallback";
+        }
+        auto log = LogMessage::borrowed(LogMessageType::Error, "a message routed to a real sink");
+        for (unsigned threads : {1, 4}) {
+            runner.run("backend/real/Error/" + name, threads, kOps, [&] { error_h.handle(log); });
+        }
+    }
+}
+
+// Group-committed errors: queued only, and waiting until durable. Each row
+// is followed by the committer's fdatasync latency and batch size.
+void benchDurable(Runner& runner, const std::filesystem::path& error_path) {
+    std::filesystem::path durable_path = error_path;
+    durable_path += ".durable";
+    // The sink appends, so start from an empty file.
+    std::filesystem::remove(durable_path);
+    auto log = LogMessage::borrowed(LogMessageType::Error, "a message routed to a real sink");
+    for (bool wait : {false, true}) {
+        for (unsigned threads : {1, 4}) {
+            std::string name = std::string("durable/real/Error/") + (wait ? "wait" : "queue");
+            DurableStats stats;
+            {
+                DurableErrorHandler durable_h(durable_path);
+                runner.run(name, threads, wait ? 500 : 20000, [&] {
+                    if (wait) {
+                        durable_h.handleDurable(log);
+                    } else {
+                        durable_h.handle(log);
+                    }
+                });
+                durable_h.waitDurable();
+                stats = durable_h.stats();
+            }
+            if (stats.commits > 0) {
+                std::printf("%-52s commit p50 %llu us, p99 %llu us, max %llu us; records/commit p50 %llu\n",
+                            (name + "/threads:" + std::to_string(threads)).c_str(),
+                            static_cast<unsigned long long>(stats.commit_latency_ns.quantile(0.5) / 1000),
+                            static_cast<unsigned long long>(stats.commit_latency_ns.quantile(0.99) / 1000),
+                            static_cast<unsigned long long>(stats.commit_latency_ns.quantile(1.0) / 1000),
+                            static_cast<unsigned long long>(stats.records_per_commit.quantile(0.5)));
+            }
+        }
+    }
+    std::filesystem::remove(durable_path);
+}
+
+// Errors written while the file rotates every 256 KiB, against the same load
+// without rotation. Renaming, reopening and compressing happen on the
+// rotator thread, so p99 should not move.
+void benchRotation(Runner& runner, const std::filesystem::path& error_path) {
+    constexpr std::size_t kOps = 200000;
+    for (bool rotating : {false, true}) {
+        RotationPolicy rotation;
+        if (rotating) {
+            rotation.max_file_bytes = 256 * 1024;
+            rotation.max_files = 3;
+        }
+        FlushPolicy policy;
+        policy.max_buffered_bytes = 4096;
+        std::uint64_t rotations = 0;
+        {
+            ErrorHandler error_h(error_path, policy, rotation);
+            auto log = LogMessage::borrowed(LogMessageType::Error, "a message routed to a real sink");
+            runner.run(std::string("rotate/real/Error/") + (rotating ? "size:256K" : "none"), 1, kOps,
+                       [&] { error_h.handle(log); });
+            rotations = error_h.rotations();
+        }
+        if (rotating && rotations > 0) {
+            std::printf("%-52s %llu rotations\n", "rotate/real/Error/size:256K",
+                        static_cast<unsigned long long>(rotations));
+        }
+    }
+    for (std::size_t index = 1; index <= 3; ++index) {
+        for (const char* extension : {"", ".gz"}) {
+            std::filesystem::remove(detail::rotatedPath(error_path, index, extension));
+        }
+    }
+}
+
+// The same structured errors through the text sink and the binary sink.
+void benchBinary(Runner& runner, const std::filesystem::path& error_path) {
+    constexpr std::size_t kOps = 20000;
+    std::filesystem::path binary_path = error_path;
+    binary_path += ".bin";
+    auto makeLog = [] {
+        return LogMessage::lazy(LogMessageType::Error, "write of {} bytes to {} failed with {}",
+                                std::size_t{4096}, "/var/lib/app/data.db", -5);
+    };
+    std::size_t text_records = 0;
+    std::size_t binary_records = 0;
+    {
+        ErrorHandler text_h(error_path);
+        BinaryLogHandler binary_h(binary_path);
+        runner.run("text/real/Error/lazy", 1, kOps, [&] {
+            text_h.handle(makeLog());
+            ++text_records;
+        });
+        runner.run("binary/real/Error/lazy", 1, kOps, [&] {
+            binary_h.handle(makeLog());
+            ++binary_records;
+        });
+    }
+    if (text_records && binary_records) {
+        std::printf("%-52s text %.1f bytes/record, binary %.1f bytes/record\n", "size/Error/lazy",
+                    static_cast<double>(std::filesystem::file_size(error_path)) / text_records,
+                    static_cast<double>(std::filesystem::file_size(binary_path)) / binary_records);
+    }
+    std::filesystem::remove(binary_path);
+}
+
+// Hammers one chain from 32 threads, then checks that every line in the
+// error log is intact and that each thread's lines arrived complete and in order.
+bool stressChain(const std::filesystem::path& error_path) {
+    constexpr unsigned kThreads = 32;
+    constexpr std::size_t kLinesPerThread = 20000;
+    {
+        FatalErrorHandler fatal_h;
+        FlushPolicy policy;
+        policy.max_buffered_bytes = 4096;
+        ErrorHandler error_h(error_path, policy);
+        WarningHandler warning_h;
+        fatal_h.setNextHandler(&error_h);
+        error_h.setNextHandler(&warning_h);
+        fatal_h.compile();
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < kThreads; ++t) {
+            workers.emplace_back([&, t] {
+                for (std::size_t i = 0; i < kLinesPerThread; ++i) {
+                    fatal_h.handle(LogMessage::formatted(LogMessageType::Error, "thread %u line %zu end", t, i));
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    std::ifstream ifs(error_path);
+    std::vector<std::size_t> next_line(kThreads, 0);
+    std::string line;
+    std::size_t total = 0;
+    while (std::getline(ifs, line)) {
+        unsigned t = 0;
+        std::size_t i = 0;
+        char end[4] = {};
+        if (std::sscanf(line.c_str(), "thread %u line %zu %3s", &t, &i, end) != 3
+            || std::string(end) != "end" || t >= kThreads || next_line[t] != i) {
+            std::printf("stress: corrupt or out-of-order line %zu: '%s'\n", total, line.c_str());
+            return false;
+        }
+        ++next_line[t];
+        ++total;
+    }
+    bool ok = total == kThreads * kLinesPerThread;
+    std::printf("stress: %zu/%zu lines intact from %u threads: %s\n",
+                total, kThreads * kLinesPerThread, kThreads, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+}  // namespace
+
+// Usage: chain_bench [name-filter]
+//        chain_bench --stress
+// WarningHandler writes to stderr, so run with 2>/dev/null to keep the table readable.
+int main(int argc, char** argv) {
+    std::filesystem::path error_path = std::filesystem::temp_directory_path() / "chain_bench_error.txt";
+    if (argc > 1 && std::string(argv[1]) == "--stress") {
+        bool ok = stressChain(error_path);
+        std::filesystem::remove(error_path);
+        return ok ? 0 : 1;
+    }
+
+    Runner runner(argc > 1 ? argv[1] : "");
+
+    benchMessages(runner);
+    benchLazy(runner);
+    benchNullChains(runner);
+    benchLongChains(runner);
+    benchMultiType(runner);
+    benchBroadcast(runner);
+    benchLimits(runner);
+    benchSwappable(runner);
+    benchRealSinks(runner, error_path);
+    benchBatches(runner, error_path);
+    benchFileBackends(runner, error_path);
+    benchRotation(runner, error_path);
+    benchDurable(runner, error_path);
+    benchBinary(runner, error_path);
+
+    std::filesystem::remove(error_path);
+    return g_consumed == SIZE_MAX ? 1 : 0;
+}
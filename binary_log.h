@@ -0,0 +1,388 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "flush_policy.h"
+#include "log_message_handler.h"
+
+// Binary log layout: the 8-byte magic, then a stream of entries, each
+// starting with a tag byte.
+//   String: varint id, varint size, bytes. Defines an interned string (lazy
+//           format strings, field keys, source files) before its first use;
+//           a later definition of the same id replaces it.
+//   Record: type byte, zigzag varint microseconds since the previous record,
+//           flags byte, then the text (varint string id when kTextRef is set,
+//           otherwise varint size and bytes), then, as the flags say, the
+//           source file id and line, the thread id, and the fields as a
+//           varint count of (varint key id or 0 for positional, kind byte,
+//           value). Integers are varints (zigzag when signed), doubles are 8
+//           raw bytes, bools one byte, strings a varint size and bytes.
+namespace detail {
+
+constexpr char kBinaryLogMagic[8] = {'L', 'O', 'G', 'B', 'I', 'N', '1', '\n'};
+
+enum class BinaryLogTag : std::uint8_t {
+    String = 1,
+    Record = 2
+};
+
+enum BinaryLogFlags : std::uint8_t {
+    kTextRef = 1,
+    kLazy = 2,
+    kWhere = 4,
+    kThread = 8,
+    kFields = 16
+};
+
+inline void putVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline std::uint64_t zigzag(std::int64_t value) {
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+inline std::int64_t unzigzag(std::uint64_t value) {
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+inline std::int64_t toMicros(std::chrono::system_clock::time_point timestamp) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(timestamp.time_since_epoch()).count();
+}
+
+}  // namespace detail
+
+// Encodes messages into the binary layout above. Lazy format strings, field
+// keys and source files, which are literals, are interned by address; any
+// other text is written inline, since a borrowed buffer may hold different
+// text each time. Each hit is still checked against the interned copy, and
+// the table is reset once it holds kMaxInterned strings, so non-literal keys
+// cannot grow it without bound.
+class BinaryLogEncoder {
+public:
+    static constexpr std::size_t kMaxInterned = 4096;
+
+    void encodeHeader(std::string& out) {
+        out.append(detail::kBinaryLogMagic, sizeof(detail::kBinaryLogMagic));
+    }
+
+    void encode(std::string& out, const LogMessage& log) {
+        using namespace detail;
+        std::int64_t micros = toMicros(log.timestamp() == std::chrono::system_clock::time_point{}
+                                           ? std::chrono::system_clock::now()
+                                           : log.timestamp());
+        // Reset between records, so every id a record uses is defined.
+        if (strings_.size() >= kMaxInterned) {
+            strings_.clear();
+        }
+        std::uint32_t text_id = log.lazy() && log.borrowedText() ? intern(out, log.message()) : 0;
+        std::uint32_t file_id = log.where().file ? intern(out, log.where().file) : 0;
+        std::size_t field_count = 0;
+        log.forEachField([&](const LogField& field) {
+            if (field.key) {
+                intern(out, field.key);
+            }
+            ++field_count;
+        });
+
+        std::uint8_t flags = (text_id ? kTextRef : 0) | (log.lazy() ? kLazy : 0) | (file_id ? kWhere : 0)
+            | (log.threadId() ? kThread : 0) | (field_count ? kFields : 0);
+        out.push_back(static_cast<char>(BinaryLogTag::Record));
+        out.push_back(static_cast<char>(log.type()));
+        putVarint(out, zigzag(micros - last_micros_));
+        last_micros_ = micros;
+        out.push_back(static_cast<char>(flags));
+        if (text_id) {
+            putVarint(out, text_id);
+        } else {
+            putVarint(out, log.message().size());
+            out.append(log.message());
+        }
+        if (file_id) {
+            putVarint(out, file_id);
+            putVarint(out, log.where().line);
+        }
+        if (log.threadId()) {
+            putVarint(out, log.threadId());
+        }
+        if (field_count) {
+            putVarint(out, field_count);
+            log.forEachField([&](const LogField& field) { encodeField(out, field); });
+        }
+    }
+
+private:
+    struct Interned {
+        std::uint32_t id;
+        std::string text;
+    };
+
+    std::unordered_map<const char*, Interned> strings_;
+    std::uint32_t next_id_ = 1;
+    std::int64_t last_micros_ = 0;
+
+    std::uint32_t intern(std::string& out, std::string_view text) {
+        Interned& interned = strings_[text.data()];
+        if (interned.id == 0 || interned.text != text) {
+            interned.id = next_id_++;
+            interned.text.assign(text);
+            out.push_back(static_cast<char>(detail::BinaryLogTag::String));
+            detail::putVarint(out, interned.id);
+            detail::putVarint(out, text.size());
+            out.append(text);
+        }
+        return interned.id;
+    }
+
+    void encodeField(std::string& out, const LogField& field) {
+        using namespace detail;
+        putVarint(out, field.key ? strings_[field.key].id : 0);
+        out.push_back(static_cast<char>(field.kind));
+        switch (field.kind) {
+        case LogFieldKind::Int:
+            putVarint(out, zigzag(field.int_value));
+            break;
+        case LogFieldKind::UInt:
+            putVarint(out, field.uint_value);
+            break;
+        case LogFieldKind::Double: {
+            char bytes[sizeof(double)];
+            std::memcpy(bytes, &field.double_value, sizeof(bytes));
+            out.append(bytes, sizeof(bytes));
+            break;
+        }
+        case LogFieldKind::Bool:
+            out.push_back(field.bool_value ? 1 : 0);
+            break;
+        case LogFieldKind::String:
+            putVarint(out, field.string_value.size());
+            out.append(field.string_value);
+            break;
+        }
+    }
+};
+
+// Decodes a binary log back into LogMessages, so they can be rendered with the
+// same appendText() the text sinks use. Throws std::runtime_error on a
+// malformed stream.
+class BinaryLogDecoder {
+public:
+    explicit BinaryLogDecoder(std::string data) : data_(std::move(data)) {
+        if (data_.compare(0, sizeof(detail::kBinaryLogMagic),
+                          std::string_view(detail::kBinaryLogMagic, sizeof(detail::kBinaryLogMagic))) != 0) {
+            throw std::runtime_error("not a binary log");
+        }
+        at_ = data_.data() + sizeof(detail::kBinaryLogMagic);
+        end_ = data_.data() + data_.size();
+    }
+
+    // Calls visit(const LogMessage&) for every record in file order.
+    template <typename Visit>
+    void forEach(Visit visit) {
+        using namespace detail;
+        while (at_ < end_) {
+            auto tag = static_cast<BinaryLogTag>(byte());
+            if (tag == BinaryLogTag::String) {
+                std::uint64_t id = varint();
+                strings_.emplace_back(bytes(varint()));
+                ids_[id] = &strings_.back();
+            } else if (tag == BinaryLogTag::Record) {
+                visit(record());
+            } else {
+                throw std::runtime_error("corrupt binary log: unknown entry tag");
+            }
+        }
+    }
+
+private:
+    std::string data_;
+    const char* at_ = nullptr;
+    const char* end_ = nullptr;
+    std::deque<std::string> strings_;
+    std::unordered_map<std::uint64_t, const std::string*> ids_;
+    std::int64_t last_micros_ = 0;
+
+    LogMessage record() {
+        using namespace detail;
+        auto type = static_cast<LogMessageType>(byte());
+        last_micros_ += unzigzag(varint());
+        std::uint8_t flags = byte();
+        std::string text_storage;
+        const char* text;
+        if (flags & kTextRef) {
+            text = string(varint()).c_str();
+        } else if (flags & kLazy) {
+            // A lazy message borrows its format string, so it must outlive the record.
+            strings_.emplace_back(bytes(varint()));
+            text = strings_.back().c_str();
+        } else {
+            text_storage = bytes(varint());
+            text = text_storage.c_str();
+        }
+        LogMessage log = flags & kLazy ? LogMessage::lazy(type, text) : LogMessage::copied(type, text);
+        SourceLocation where;
+        if (flags & kWhere) {
+            where.file = string(varint()).c_str();
+            where.line = static_cast<unsigned>(varint());
+        }
+        std::uint64_t thread_id = flags & kThread ? varint() : 0;
+        log.stamp(where, std::chrono::system_clock::time_point(std::chrono::microseconds(last_micros_)), thread_id);
+        if (flags & kFields) {
+            for (std::uint64_t count = varint(); count > 0; --count) {
+                decodeField(log);
+            }
+        }
+        return log;
+    }
+
+    void decodeField(LogMessage& log) {
+        using namespace detail;
+        std::uint64_t key_id = varint();
+        const char* key = key_id ? string(key_id).c_str() : nullptr;
+        switch (static_cast<LogFieldKind>(byte())) {
+        case LogFieldKind::Int:
+            log.with(key, unzigzag(varint()));
+            return;
+        case LogFieldKind::UInt:
+            log.with(key, varint());
+            return;
+        case LogFieldKind::Double: {
+            std::string raw = bytes(sizeof(double));
+            double value;
+            std::memcpy(&value, raw.data(), sizeof(value));
+            log.with(key, value);
+            return;
+        }
+        case LogFieldKind::Bool:
+            log.with(key, byte() != 0);
+            return;
+        case LogFieldKind::String:
+            log.with(key, bytes(varint()));
+            return;
+        }
+        throw std::runtime_error("corrupt binary log: unknown field kind");
+    }
+
+    const std::string& string(std::uint64_t id) const {
+        auto it = ids_.find(id);
+        if (it == ids_.end()) {
+            throw std::runtime_error("corrupt binary log: undefined string id");
+        }
+        return *it->second;
+    }
+    std::uint8_t byte() {
+        if (at_ >= end_) {
+            throw std::runtime_error("corrupt binary log: truncated entry");
+        }
+        return static_cast<std::uint8_t>(*at_++);
+    }
+    std::uint64_t varint() {
+        std::uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            std::uint8_t b = byte();
+            value |= static_cast<std::uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("corrupt binary log: varint too long");
+    }
+    std::string bytes(std::uint64_t size) {
+        if (size > static_cast<std::uint64_t>(end_ - at_)) {
+            throw std::runtime_error("corrupt binary log: truncated entry");
+        }
+        std::string result(at_, static_cast<std::size_t>(size));
+        at_ += size;
+        return result;
+    }
+};
+
+// Writes the claimed types as compact binary records; render the file with
+// logdecode. Interned strings must be defined before they are used, so all
+// threads share one buffer under a lock. The file is truncated on
+// construction, as with ErrorHandler.
+class BinaryLogHandler final : public MultiTypeHandler {
+public:
+    explicit BinaryLogHandler(const std::filesystem::path& filepath,
+                              LogMessageTypeMask types = logMessageTypeMask(LogMessageType::Error),
+                              FlushPolicy policy = {})
+    : MultiTypeHandler(types), policy_(policy) {
+        ofs_.rdbuf()->pubsetbuf(nullptr, 0);
+        ofs_.open(filepath, std::ios::binary | std::ios::trunc | std::ios::out);
+        encoder_.encodeHeader(buffer_);
+        flush();
+        if (policy_.timerPeriod().count() > 0 || policy_.flush_on_shutdown) {
+            scheduler_id_ = FlushScheduler::instance().add([this] { flush(); }, policy_.timerPeriod(),
+                                                           policy_.flush_on_shutdown);
+        }
+    }
+    BinaryLogHandler(const BinaryLogHandler&) = delete;
+    BinaryLogHandler& operator=(const BinaryLogHandler&) = delete;
+    ~BinaryLogHandler() override {
+        if (scheduler_id_ != 0) {
+            FlushScheduler::instance().remove(scheduler_id_);
+        }
+        if (policy_.flush_on_shutdown) {
+            flush();
+        }
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writeOut();
+    }
+
+private:
+    FlushPolicy policy_;
+    FlushScheduler::Id scheduler_id_ = 0;
+    mutable std::mutex mutex_;
+    mutable std::ofstream ofs_;
+    mutable std::string buffer_;
+    mutable BinaryLogEncoder encoder_;
+    mutable std::chrono::steady_clock::time_point oldest_;
+
+    void operate(const LogMessage& log) const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(log);
+    }
+    void operateBatch(const LogMessage* const* logs, std::size_t count) const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t i = 0; i < count; ++i) {
+            append(*logs[i]);
+        }
+    }
+
+    void append(const LogMessage& log) const {
+        if (buffer_.empty()) {
+            oldest_ = std::chrono::steady_clock::now();
+        }
+        encoder_.encode(buffer_, log);
+        if (policy_.flushesOn(log.type()) || buffer_.size() >= policy_.max_buffered_bytes
+            || (policy_.max_delay.count() > 0 && std::chrono::steady_clock::now() - oldest_ >= policy_.max_delay)) {
+            writeOut();
+        }
+    }
+    void writeOut() const {
+        if (!buffer_.empty() && ofs_.is_open()) {
+            ofs_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        }
+        buffer_.clear();
+    }
+};
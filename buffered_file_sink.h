@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "file_output.h"
+#include "flush_policy.h"
+#include "log_rotation.h"
+#include "thread_buffers.h"
+
+// Each thread appends to its own buffer, so the hot path only takes an
+// uncontended lock. A buffer always holds whole lines and is written with a
+// single call under the file lock, so lines from different threads never
+// interleave. Lines keep their order within a thread; flush() merges the
+// buffers of all threads, so there is no global order between threads.
+//
+// With a RotationPolicy, a FileRotator thread replaces the file when it grows
+// too large or too old; writers only notice the swap of the output. The
+// FileBackend decides whether writing out a buffer blocks on write(2) or is
+// queued to io_uring.
+class BufferedFileSink {
+public:
+    BufferedFileSink(const std::filesystem::path& filepath, FlushPolicy policy, bool truncate = false,
+                     RotationPolicy rotation = {}, FileBackend backend = FileBackend::Stream)
+    : policy_(policy), buffers_(policy.max_buffered_bytes + 256), filepath_(filepath), backend_(backend),
+      output_(detail::openFileOutput(filepath, truncate, backend)) {
+        if (!truncate) {
+            std::error_code error;
+            std::uintmax_t size = std::filesystem::file_size(filepath, error);
+            file_bytes_ = error ? 0 : static_cast<std::size_t>(size);
+        }
+        if (rotation.enabled()) {
+            rotator_ = std::make_unique<FileRotator>(filepath, rotation, [this] { reopen(); });
+        }
+        if (policy_.timerPeriod().count() > 0 || policy_.flush_on_shutdown) {
+            scheduler_id_ = FlushScheduler::instance().add([this] { flush(); }, policy_.timerPeriod(),
+                                                           policy_.flush_on_shutdown);
+        }
+    }
+    BufferedFileSink(const BufferedFileSink&) = delete;
+    BufferedFileSink& operator=(const BufferedFileSink&) = delete;
+    ~BufferedFileSink() {
+        if (scheduler_id_ != 0) {
+            FlushScheduler::instance().remove(scheduler_id_);
+        }
+        if (policy_.flush_on_shutdown) {
+            flush();
+        }
+    }
+
+    // flush_now forces a write, e.g. for a type in FlushPolicy::flush_types.
+    void append(std::string_view line, bool flush_now = false) {
+        detail::ThreadBuffer& buffer = buffers_.local();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.touch();
+        buffer.data.append(line);
+        buffer.data.push_back('\n');
+        if (flush_now || buffer.due(policy_)) {
+            writeOut(buffer);
+        }
+    }
+    // Appends count lines under a single lock; line_at(i) yields the i-th line.
+    template <typename LineAt>
+    void appendLines(std::size_t count, LineAt line_at, bool flush_now = false) {
+        detail::ThreadBuffer& buffer = buffers_.local();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.touch();
+        for (std::size_t i = 0; i < count; ++i) {
+            buffer.data.append(line_at(i));
+            buffer.data.push_back('\n');
+        }
+        if (flush_now || buffer.due(policy_)) {
+            writeOut(buffer);
+        }
+    }
+    // Returns once every buffered line has reached the kernel. Waits for
+    // writes still in flight by polling with the file lock released, so a
+    // logging thread whose buffer comes due meanwhile is not held up.
+    void flush() {
+        buffers_.forEach([this](detail::ThreadBuffer& buffer) { writeOut(buffer); });
+        const detail::FileOutput* output;
+        std::uint64_t mark;
+        {
+            std::lock_guard<std::mutex> lock(file_mutex_);
+            output = output_.get();
+            mark = output_->writeMark();
+        }
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(file_mutex_);
+                // After a rotation the rotator drains the old file itself.
+                if (output_.get() != output || output_->reached(mark)) {
+                    output_->flush();
+                    return;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+    const FlushPolicy& policy() const {
+        return policy_;
+    }
+    // The backend in use, which is Stream if io_uring was asked for but is unavailable.
+    FileBackend backend() const {
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        return output_->backend();
+    }
+    std::uint64_t rotations() const {
+        return rotator_ ? rotator_->rotations() : 0;
+    }
+    // Writes whose bytes never reached the file, across rotations.
+    std::uint64_t writeErrors() const {
+        std::lock_guard<std::mutex> lock(file_mutex_);
+        return closed_write_errors_.load(std::memory_order_relaxed) + output_->writeErrors();
+    }
+
+private:
+    FlushPolicy policy_;
+    detail::ThreadBuffers buffers_;
+    FlushScheduler::Id scheduler_id_ = 0;
+    std::filesystem::path filepath_;
+    FileBackend backend_;
+    mutable std::mutex file_mutex_;
+    std::unique_ptr<detail::FileOutput> output_;
+    std::size_t file_bytes_ = 0;
+    std::atomic<std::uint64_t> closed_write_errors_{0};
+    // Last, so its thread is joined before anything it touches is destroyed.
+    std::unique_ptr<FileRotator> rotator_;
+
+    void writeOut(detail::ThreadBuffer& buffer) {
+        if (buffer.data.empty()) {
+            return;
+        }
+        std::size_t file_bytes;
+        {
+            std::lock_guard<std::mutex> lock(file_mutex_);
+            output_->write(buffer.data.data(), buffer.data.size());
+            file_bytes = file_bytes_ += buffer.data.size();
+        }
+        buffer.data.clear();
+        if (rotator_) {
+            rotator_->noteSize(file_bytes);
+        }
+    }
+
+    // Runs on the rotator thread. The new file is opened before taking the
+    // lock, and the old one is drained and closed after releasing it.
+    void reopen() {
+        std::unique_ptr<detail::FileOutput> next = detail::openFileOutput(filepath_, true, backend_);
+        {
+            std::lock_guard<std::mutex> lock(file_mutex_);
+            output_.swap(next);
+            file_bytes_ = 0;
+        }
+        while (!next->reached(next->writeMark())) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        closed_write_errors_.fetch_add(next->writeErrors(), std::memory_order_relaxed);
+    }
+};
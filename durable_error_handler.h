@@ -0,0 +1,291 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include "log_format.h"
+#include "log_message_handler.h"
+
+struct DurabilityPolicy {
+    // Commit at least this often while records are pending.
+    std::chrono::milliseconds commit_interval{5};
+    // Commit as soon as this many records are pending.
+    std::size_t commit_records = 256;
+};
+
+// Power-of-two buckets: bucket i counts values in [2^i, 2^(i+1)), bucket 0
+// also counts 0.
+struct Log2Histogram {
+    static constexpr std::size_t kBuckets = 40;
+
+    std::array<std::uint64_t, kBuckets> buckets{};
+    std::uint64_t count = 0;
+
+    void add(std::uint64_t value) {
+        std::size_t bucket = 0;
+        while (value > 1 && bucket + 1 < kBuckets) {
+            value >>= 1;
+            ++bucket;
+        }
+        ++buckets[bucket];
+        ++count;
+    }
+    // Upper bound of the bucket holding the q-th quantile, q in [0, 1].
+    std::uint64_t quantile(double q) const {
+        if (count == 0) {
+            return 0;
+        }
+        auto rank = std::min(static_cast<std::uint64_t>(q * static_cast<double>(count)), count - 1);
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+            seen += buckets[bucket];
+            if (seen > rank) {
+                return (std::uint64_t{2} << bucket) - 1;
+            }
+        }
+        return 0;
+    }
+};
+
+struct DurableStats {
+    std::uint64_t commits = 0;
+    std::uint64_t records = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t sync_errors = 0;
+    // Nanoseconds from taking a batch to fdatasync returning.
+    Log2Histogram commit_latency_ns;
+    Log2Histogram records_per_commit;
+};
+
+// Group commit: writers append lines to one shared buffer and get a sequence
+// number back; a committer thread takes the whole buffer, writes it and calls
+// fdatasync, then marks every record in it durable. One fdatasync covers all
+// records that arrived while the previous one ran, so its cost is shared
+// instead of paid per message. Writers only wait if they ask to.
+//
+// A failed commit is kept and retried every commit_interval until it
+// succeeds, so records are only marked durable once fdatasync has covered
+// them. After a failed fdatasync the whole batch is written again, as the
+// kernel may have dropped its dirty pages; it can then appear twice in the
+// file. A commit still failing when the sink is destroyed is abandoned.
+class DurableFileSink {
+public:
+    // Appends to an existing file, so records kept before a crash survive the
+    // restart.
+    DurableFileSink(const std::filesystem::path& filepath, DurabilityPolicy policy) : policy_(policy) {
+        fd_ = ::open(filepath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + filepath.string());
+        }
+        committer_ = std::thread([this] { run(); });
+    }
+    DurableFileSink(const DurableFileSink&) = delete;
+    DurableFileSink& operator=(const DurableFileSink&) = delete;
+    ~DurableFileSink() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        committer_.join();
+        ::close(fd_);
+    }
+
+    // Returns the record's sequence number, for waitDurable().
+    std::uint64_t append(std::string_view line) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.append(line);
+        pending_.push_back('\n');
+        std::uint64_t sequence = ++appended_;
+        if (appended_ - taken_ >= policy_.commit_records) {
+            wake_.notify_one();
+        }
+        return sequence;
+    }
+    // Blocks until the record with this sequence number, and all before it,
+    // are on disk, and returns true; or until a commit covering it fails, and
+    // returns false, while the record stays queued for a retry. Asks for a
+    // commit right away rather than at the next interval.
+    bool waitDurable(std::uint64_t sequence) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (durable_ >= sequence) {
+            return true;
+        }
+        if (sequence > requested_) {
+            requested_ = sequence;
+            wake_.notify_one();
+        }
+        std::uint64_t failures = failures_;
+        durable_changed_.wait(lock, [&] {
+            return durable_ >= sequence || (failures_ != failures && failed_through_ >= sequence);
+        });
+        return durable_ >= sequence;
+    }
+    // Everything appended so far, by any thread.
+    bool waitDurable() {
+        std::uint64_t sequence;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sequence = appended_;
+        }
+        return waitDurable(sequence);
+    }
+    DurableStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    DurabilityPolicy policy_;
+    int fd_ = -1;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable durable_changed_;
+    std::string pending_;
+    std::uint64_t appended_ = 0;
+    std::uint64_t taken_ = 0;
+    std::uint64_t durable_ = 0;
+    // Failed commits so far, and the last sequence number the latest covered.
+    std::uint64_t failures_ = 0;
+    std::uint64_t failed_through_ = 0;
+    // Highest sequence number someone is waiting for.
+    std::uint64_t requested_ = 0;
+    bool stopping_ = false;
+    DurableStats stats_;
+    std::thread committer_;
+
+    void run() {
+        // Records taken but not yet durable; written[0, written) already
+        // reached the file.
+        std::string batch;
+        std::size_t written = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait_for(lock, policy_.commit_interval, [this] {
+                return stopping_ || requested_ > taken_ || appended_ - taken_ >= policy_.commit_records;
+            });
+            if (appended_ == taken_ && batch.empty()) {
+                if (stopping_) {
+                    return;
+                }
+                continue;
+            }
+            batch.append(pending_);
+            pending_.clear();
+            std::uint64_t last = appended_;
+            std::uint64_t records = last - durable_;
+            taken_ = last;
+            lock.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+            bool wrote = writeAll(batch, written);
+            bool ok = wrote && ::fdatasync(fd_) == 0;
+            auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            std::size_t bytes = batch.size();
+            if (ok) {
+                batch.clear();
+                written = 0;
+            } else if (wrote) {
+                written = 0;
+            }
+
+            lock.lock();
+            ++stats_.commits;
+            stats_.commit_latency_ns.add(static_cast<std::uint64_t>(latency));
+            if (ok) {
+                durable_ = last;
+                stats_.records += records;
+                stats_.bytes += bytes;
+                stats_.records_per_commit.add(records);
+            } else {
+                ++failures_;
+                failed_through_ = last;
+                ++stats_.sync_errors;
+            }
+            durable_changed_.notify_all();
+            if (!ok && stopping_) {
+                return;
+            }
+        }
+    }
+
+    // Writes data from offset on, advancing offset past what was written.
+    bool writeAll(const std::string& data, std::size_t& offset) const {
+        while (offset < data.size()) {
+            ssize_t written = ::write(fd_, data.data() + offset, data.size() - offset);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            offset += static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+};
+
+// Alternative to ErrorHandler for errors that must survive a crash: lines
+// are group-committed with fdatasync by a DurableFileSink. handle() returns
+// as soon as the line is queued; handleDurable() or waitDurable() block
+// until it is on disk, and return false if a commit covering it failed
+// instead; the record is kept and retried, and stats().sync_errors counts
+// the failures.
+class DurableErrorHandler final : public LogMessageHandler {
+public:
+    static constexpr LogMessageType kLogMessageType = LogMessageType::Error;
+
+    explicit DurableErrorHandler(const std::filesystem::path& filepath, DurabilityPolicy policy = {})
+    : LogMessageHandler(kLogMessageType), sink_(filepath, policy) {
+    }
+
+    // Routes log through the chain starting here and, if this handler took
+    // it, waits until it is durable. Returns false only if this handler took
+    // it and the commit covering it failed.
+    bool handleDurable(const LogMessage& log) {
+        LastRecord& last = lastRecord();
+        last = LastRecord{};
+        handle(log);
+        return last.sink != &sink_ || sink_.waitDurable(last.sequence);
+    }
+    // Waits for everything this handler has accepted so far.
+    bool waitDurable() {
+        return sink_.waitDurable();
+    }
+    DurableStats stats() const {
+        return sink_.stats();
+    }
+
+private:
+    struct LastRecord {
+        const DurableFileSink* sink = nullptr;
+        std::uint64_t sequence = 0;
+    };
+
+    mutable DurableFileSink sink_;
+
+    static LastRecord& lastRecord() {
+        thread_local LastRecord last;
+        return last;
+    }
+
+    void operate(const LogMessage& log) const override {
+        std::uint64_t sequence = sink_.append(renderText(log));
+        lastRecord() = LastRecord{&sink_, sequence};
+    }
+};
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define LOG_HAVE_IO_URING 1
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// How a file sink hands its bytes to the kernel. Stream does a blocking
+// write per flushed buffer. IoUring (Linux) copies the buffer into one of a
+// few registered buffers and submits it, so the logging thread does not wait
+// for the disk; when every buffer is still in flight it writes with a plain
+// pwrite(2) instead. Where io_uring is not available, or rejects writes, it
+// falls back to pwrite(2) altogether. Writes the kernel cannot finish inline
+// run on its worker threads, which compete with the logging threads for CPU:
+// with few cores, Stream has the lower tail latency.
+enum class FileBackend {
+    Stream,
+    IoUring
+};
+
+namespace detail {
+
+// An open log file. Callers serialize all calls (the sinks hold their file
+// lock), so implementations need no locking of their own.
+class FileOutput {
+public:
+    virtual ~FileOutput() = default;
+
+    virtual bool isOpen() const = 0;
+    virtual void write(const char* data, std::size_t size) = 0;
+    // Identifies the writes made so far, for reached().
+    virtual std::uint64_t writeMark() const {
+        return 0;
+    }
+    // Handles finished writes without blocking, and tells whether every write
+    // up to mark has reached the kernel. Sinks poll it with their file lock
+    // released in between, so writers are never held up by the disk.
+    virtual bool reached(std::uint64_t mark) {
+        (void)mark;
+        return true;
+    }
+    // Asks for what has reached the kernel to be synced; does not wait.
+    virtual void flush() = 0;
+    virtual FileBackend backend() const = 0;
+    // Writes that failed and whose bytes were lost.
+    virtual std::uint64_t writeErrors() const = 0;
+};
+
+class StreamFileOutput final : public FileOutput {
+public:
+    StreamFileOutput(const std::filesystem::path& filepath, bool truncate) {
+        ofs_.rdbuf()->pubsetbuf(nullptr, 0);
+        ofs_.open(filepath, std::ios::binary | (truncate ? std::ios::trunc | std::ios::out : std::ios::app));
+    }
+
+    bool isOpen() const override {
+        return ofs_.is_open();
+    }
+    void write(const char* data, std::size_t size) override {
+        if (ofs_.is_open() && !ofs_.write(data, static_cast<std::streamsize>(size))) {
+            ++write_errors_;
+            ofs_.clear();
+        }
+    }
+    void flush() override {
+    }
+    FileBackend backend() const override {
+        return FileBackend::Stream;
+    }
+    std::uint64_t writeErrors() const override {
+        return write_errors_;
+    }
+
+private:
+    std::ofstream ofs_;
+    std::uint64_t write_errors_ = 0;
+};
+
+#ifdef LOG_HAVE_IO_URING
+
+// A minimal io_uring writer on raw syscalls: kBufferCount buffers of
+// kBufferSize bytes, registered with the ring when the memlock limit allows,
+// and written at explicit offsets, since writes may complete out of order.
+// write() never waits for the ring: with no buffer free it calls pwrite(2),
+// and a write that completes with an error is redone the same way. flush()
+// queues an fdatasync that completes in the background; a flush while one is
+// running queues the next.
+class UringFileOutput final : public FileOutput {
+public:
+    static constexpr unsigned kBufferCount = 8;
+    static constexpr std::size_t kBufferSize = 64 * 1024;
+
+    UringFileOutput(const std::filesystem::path& filepath, bool truncate) {
+        fd_ = ::open(filepath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+        if (fd_ < 0) {
+            return;
+        }
+        offset_ = truncate ? 0 : static_cast<std::uint64_t>(::lseek(fd_, 0, SEEK_END));
+        buffers_.resize(kBufferCount * kBufferSize);
+        slots_.resize(kBufferCount);
+        for (unsigned index = kBufferCount; index-- > 0;) {
+            free_.push_back(index);
+        }
+        setUp();
+    }
+    UringFileOutput(const UringFileOutput&) = delete;
+    UringFileOutput& operator=(const UringFileOutput&) = delete;
+    ~UringFileOutput() override {
+        if (ring_fd_ >= 0) {
+            drain();
+            if (sq_ring_ != MAP_FAILED) {
+                ::munmap(sq_ring_, sq_ring_size_);
+            }
+            if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+                ::munmap(cq_ring_, cq_ring_size_);
+            }
+            if (sqes_ != MAP_FAILED) {
+                ::munmap(sqes_, sqes_size_);
+            }
+            ::close(ring_fd_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    bool isOpen() const override {
+        return fd_ >= 0;
+    }
+    void write(const char* data, std::size_t size) override {
+        if (fd_ < 0) {
+            return;
+        }
+        if (ring_fd_ >= 0) {
+            reap(0);
+        }
+        while (size > 0) {
+            if (ring_fd_ < 0 || !ring_writes_ || free_.empty()) {
+                writeAt(data, size, offset_);
+                offset_ += size;
+                return;
+            }
+            std::size_t chunk = size < kBufferSize ? size : kBufferSize;
+            unsigned index = free_.back();
+            free_.pop_back();
+            char* buffer = buffers_.data() + index * kBufferSize;
+            std::memcpy(buffer, data, chunk);
+            slots_[index] = Slot{static_cast<std::uint32_t>(chunk), offset_, ++submitted_, true};
+            io_uring_sqe sqe{};
+            sqe.opcode = registered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe.fd = fd_;
+            sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+            sqe.len = static_cast<std::uint32_t>(chunk);
+            sqe.off = offset_;
+            sqe.buf_index = static_cast<std::uint16_t>(index);
+            sqe.user_data = index;
+            submit(sqe);
+            offset_ += chunk;
+            data += chunk;
+            size -= chunk;
+        }
+    }
+    std::uint64_t writeMark() const override {
+        return submitted_;
+    }
+    bool reached(std::uint64_t mark) override {
+        if (ring_fd_ < 0) {
+            return true;
+        }
+        reap(0);
+        for (const Slot& slot : slots_) {
+            if (slot.busy && slot.sequence <= mark) {
+                return false;
+            }
+        }
+        return true;
+    }
+    void flush() override {
+        if (ring_fd_ < 0) {
+            return;
+        }
+        if (sync_in_flight_) {
+            sync_wanted_ = true;
+        } else {
+            submitSync();
+        }
+    }
+    FileBackend backend() const override {
+        return ring_fd_ >= 0 && ring_writes_ ? FileBackend::IoUring : FileBackend::Stream;
+    }
+    std::uint64_t writeErrors() const override {
+        return write_errors_;
+    }
+
+private:
+    static constexpr std::uint64_t kSyncTag = ~std::uint64_t{0};
+
+    struct Slot {
+        std::uint32_t length;
+        std::uint64_t offset;
+        std::uint64_t sequence;
+        bool busy;
+    };
+
+    int fd_ = -1;
+    int ring_fd_ = -1;
+    bool registered_ = false;
+    // Cleared when the kernel rejects the write opcode itself.
+    bool ring_writes_ = true;
+    bool sync_in_flight_ = false;
+    bool sync_wanted_ = false;
+    std::uint64_t offset_ = 0;
+    // Ring writes submitted so far; each slot records its own number.
+    std::uint64_t submitted_ = 0;
+    std::uint64_t write_errors_ = 0;
+    std::vector<char> buffers_;
+    std::vector<Slot> slots_;
+    std::vector<unsigned> free_;
+
+    void* sq_ring_ = MAP_FAILED;
+    void* cq_ring_ = MAP_FAILED;
+    void* sqes_ = MAP_FAILED;
+    std::size_t sq_ring_size_ = 0;
+    std::size_t cq_ring_size_ = 0;
+    std::size_t sqes_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    // Leaves ring_fd_ at -1, and so the plain pwrite(2) path in use, if any
+    // step fails: no io_uring in the kernel, or blocked by a seccomp policy.
+    void setUp() {
+        io_uring_params params{};
+        int ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, kBufferCount * 2, &params));
+        if (ring_fd < 0) {
+            return;
+        }
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = sq_ring_size_ > cq_ring_size_ ? sq_ring_size_ : cq_ring_size_;
+        }
+        sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                          IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap ? sq_ring_
+                               : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        ring_fd, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                       IORING_OFF_SQES);
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            if (sq_ring_ != MAP_FAILED) {
+                ::munmap(sq_ring_, sq_ring_size_);
+            }
+            if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+                ::munmap(cq_ring_, cq_ring_size_);
+            }
+            if (sqes_ != MAP_FAILED) {
+                ::munmap(sqes_, sqes_size_);
+            }
+            sq_ring_ = cq_ring_ = sqes_ = MAP_FAILED;
+            ::close(ring_fd);
+            return;
+        }
+        auto* sq = static_cast<char*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        ring_fd_ = ring_fd;
+
+        std::vector<iovec> iovecs(kBufferCount);
+        for (unsigned index = 0; index < kBufferCount; ++index) {
+            iovecs[index] = iovec{buffers_.data() + index * kBufferSize, kBufferSize};
+        }
+        registered_ = ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, iovecs.data(),
+                                kBufferCount) == 0;
+    }
+
+    // Every write holds a buffer and a possible fsync takes one more entry,
+    // so the submission queue (2 * kBufferCount entries) never overflows.
+    void submit(const io_uring_sqe& sqe) {
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & *sq_mask_;
+        static_cast<io_uring_sqe*>(sqes_)[index] = sqe;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        while (::syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0) < 0 && errno == EINTR) {
+        }
+    }
+
+    void submitSync() {
+        io_uring_sqe sqe{};
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fd = fd_;
+        sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe.user_data = kSyncTag;
+        sync_in_flight_ = true;
+        submit(sqe);
+    }
+
+    // Handles the completions that are ready, first waiting for at least
+    // min_complete of them.
+    void reap(unsigned min_complete) {
+        if (min_complete > 0) {
+            while (::syscall(__NR_io_uring_enter, ring_fd_, 0, min_complete, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+                   && errno == EINTR) {
+            }
+        }
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            if (cqe.user_data == kSyncTag) {
+                sync_in_flight_ = false;
+                if (sync_wanted_) {
+                    sync_wanted_ = false;
+                    submitSync();
+                }
+                continue;
+            }
+            auto index = static_cast<unsigned>(cqe.user_data);
+            Slot& slot = slots_[index];
+            if (cqe.res < 0) {
+                // E.g. -EINVAL for IORING_OP_WRITE before Linux 5.6.
+                if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+                    ring_writes_ = false;
+                }
+                writeAt(buffers_.data() + index * kBufferSize, slot.length, slot.offset);
+            } else if (static_cast<std::uint32_t>(cqe.res) < slot.length) {
+                // Short writes are rare on regular files; finish them inline.
+                writeAt(buffers_.data() + index * kBufferSize + cqe.res, slot.length - cqe.res,
+                        slot.offset + static_cast<std::uint64_t>(cqe.res));
+            }
+            slot.busy = false;
+            free_.push_back(index);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    void drain() {
+        while (free_.size() < kBufferCount || sync_in_flight_) {
+            reap(1);
+        }
+    }
+
+    void writeAt(const char* data, std::size_t size, std::uint64_t offset) {
+        while (size > 0) {
+            ssize_t written = ::pwrite(fd_, data, size, static_cast<off_t>(offset));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ++write_errors_;
+                return;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+            offset += static_cast<std::uint64_t>(written);
+        }
+    }
+};
+
+#endif
+
+inline std::unique_ptr<FileOutput> openFileOutput(const std::filesystem::path& filepath, bool truncate,
+                                                  FileBackend backend) {
+#ifdef LOG_HAVE_IO_URING
+    if (backend == FileBackend::IoUring) {
+        return std::make_unique<UringFileOutput>(filepath, truncate);
+    }
+#else
+    (void)backend;
+#endif
+    return std::make_unique<StreamFileOutput>(filepath, truncate);
+}
+
+}  // namespace detail
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "log_message.h"
+
+// When a buffering sink hands its bytes to the OS. Shared by every
+// stream-backed handler (ErrorHandler, WarningHandler, BinaryLogHandler);
+// any rule that fires flushes the whole buffer.
+struct FlushPolicy {
+    // Flush once this many bytes are buffered; 0 flushes after every message.
+    std::size_t max_buffered_bytes = 64 * 1024;
+    // Flush when the oldest buffered message is older than this: checked as
+    // messages arrive and, unless flush_interval is set, enforced by the
+    // FlushScheduler thread, so a line waits at most about twice this long
+    // even if nothing else is logged. 0 disables.
+    std::chrono::milliseconds max_delay{1000};
+    // Flush right after a message of one of these types. For a severity
+    // threshold use logMessageTypeRange(threshold, LogMessageType::FatalError).
+    LogMessageTypeMask flush_types = logMessageTypeMask(LogMessageType::FatalError);
+    // Flush from the FlushScheduler thread at this period instead of
+    // max_delay; 0 uses max_delay.
+    std::chrono::milliseconds flush_interval{0};
+    // Flush before a FatalErrorHandler throws.
+    bool flush_on_fatal = true;
+    // Flush when the sink is destroyed, or at exit if it never is.
+    bool flush_on_shutdown = true;
+
+    // One write per message, as an unbuffered stream would do.
+    static FlushPolicy perMessage() {
+        FlushPolicy policy;
+        policy.max_buffered_bytes = 0;
+        return policy;
+    }
+    // Small buffer and a short timer, for output someone is watching.
+    static FlushPolicy interactive() {
+        FlushPolicy policy;
+        policy.max_buffered_bytes = 4096;
+        policy.max_delay = std::chrono::milliseconds(100);
+        policy.flush_interval = std::chrono::milliseconds(100);
+        return policy;
+    }
+
+    // Period of the background flush; 0 when there is none.
+    std::chrono::milliseconds timerPeriod() const {
+        return flush_interval.count() > 0 ? flush_interval : max_delay;
+    }
+    bool flushesOn(LogMessageType type) const {
+        return (flush_types & logMessageTypeMask(type)) != 0;
+    }
+};
+
+// Process-wide helper for the time- and exit-driven parts of FlushPolicy.
+// Sinks register a flush callback; one background thread, started on the
+// first registration with an interval, runs the periodic flushes, and at exit
+// the callbacks of sinks that are still registered run once more, so handlers
+// that are never destroyed do not lose their last lines.
+class FlushScheduler {
+public:
+    using Id = std::uint64_t;
+
+    static FlushScheduler& instance() {
+        static FlushScheduler scheduler;
+        return scheduler;
+    }
+
+    Id add(std::function<void()> flush, std::chrono::milliseconds interval, bool at_shutdown) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Id id = next_id_++;
+        entries_.push_back(Entry{id, std::move(flush), interval, Clock::now() + interval, at_shutdown});
+        if (interval.count() > 0 && !timer_.joinable()) {
+            timer_ = std::thread([this] { run(); });
+        }
+        wake_.notify_one();
+        return id;
+    }
+    // Callbacks run under the scheduler lock, so once remove() returns the
+    // callback is not running and never will again.
+    void remove(Id id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                      [id](const Entry& entry) { return entry.id == id; }),
+                       entries_.end());
+    }
+
+    FlushScheduler(const FlushScheduler&) = delete;
+    FlushScheduler& operator=(const FlushScheduler&) = delete;
+    ~FlushScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        if (timer_.joinable()) {
+            timer_.join();
+        }
+        for (Entry& entry : entries_) {
+            if (entry.at_shutdown) {
+                entry.flush();
+            }
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Id id;
+        std::function<void()> flush;
+        std::chrono::milliseconds interval;
+        Clock::time_point due;
+        bool at_shutdown;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<Entry> entries_;
+    Id next_id_ = 1;
+    bool stopping_ = false;
+    std::thread timer_;
+
+    FlushScheduler() = default;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            Clock::time_point now = Clock::now();
+            Clock::time_point next = Clock::time_point::max();
+            for (Entry& entry : entries_) {
+                if (entry.interval.count() <= 0) {
+                    continue;
+                }
+                if (entry.due <= now) {
+                    entry.flush();
+                    entry.due = now + entry.interval;
+                }
+                next = std::min(next, entry.due);
+            }
+            if (next == Clock::time_point::max()) {
+                wake_.wait(lock);
+            } else {
+                wake_.wait_until(lock, next);
+            }
+        }
+    }
+};
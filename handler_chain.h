@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "log_message_handler.h"
+
+namespace detail {
+
+struct ArenaDeleter {
+    std::size_t align = alignof(std::max_align_t);
+
+    void operator()(std::byte* arena) const {
+        ::operator delete(arena, std::align_val_t(align));
+    }
+};
+
+}  // namespace detail
+
+// Owns a chain of handlers. All handlers live in one block allocated by
+// build(), laid out in chain order, so a traversal walks forward through
+// adjacent memory, and the whole chain is freed at once. If a handler
+// constructor throws, the ones already built are destroyed before the
+// exception leaves build(). Moving a HandlerChain does not move the handlers.
+//
+//     HandlerChain chain = HandlerChain::Builder()
+//                              .add<FatalErrorHandler>()
+//                              .add<ErrorHandler>("error.txt")
+//                              .build();
+//     chain.head().handle(log);
+class HandlerChain {
+public:
+    class Builder {
+    public:
+        // Arguments are copied or moved into the builder and passed to the
+        // constructor as rvalues when the chain is built.
+        template <typename Handler, typename... Args>
+        Builder& add(Args&&... args) {
+            static_assert(std::is_base_of_v<LogMessageHandler, Handler>, "Handler must derive from LogMessageHandler");
+            entries_.push_back(Entry{
+                sizeof(Handler), alignof(Handler),
+                [arguments = std::make_tuple(std::forward<Args>(args)...)](void* at) mutable -> LogMessageHandler* {
+                    return std::apply(
+                        [at](auto&... unpacked) { return new (at) Handler(std::move(unpacked)...); }, arguments);
+                }});
+            return *this;
+        }
+
+        HandlerChain build() {
+            if (entries_.empty()) {
+                throw std::invalid_argument("HandlerChain needs at least one handler");
+            }
+            std::vector<std::size_t> offsets;
+            offsets.reserve(entries_.size());
+            std::size_t size = 0;
+            std::size_t align = alignof(std::max_align_t);
+            for (const Entry& entry : entries_) {
+                size = (size + entry.align - 1) / entry.align * entry.align;
+                offsets.push_back(size);
+                size += entry.size;
+                align = std::max(align, entry.align);
+            }
+
+            HandlerChain chain;
+            chain.arena_.reset(static_cast<std::byte*>(::operator new(size, std::align_val_t(align))));
+            chain.arena_.get_deleter().align = align;
+            chain.handlers_.reserve(entries_.size());
+            for (std::size_t i = 0; i < entries_.size(); ++i) {
+                chain.handlers_.push_back(entries_[i].construct(chain.arena_.get() + offsets[i]));
+            }
+            for (std::size_t i = 0; i + 1 < chain.handlers_.size(); ++i) {
+                chain.handlers_[i]->setNextHandler(chain.handlers_[i + 1]);
+            }
+            return chain;
+        }
+
+    private:
+        struct Entry {
+            std::size_t size;
+            std::size_t align;
+            std::function<LogMessageHandler*(void*)> construct;
+        };
+
+        std::vector<Entry> entries_;
+    };
+
+    HandlerChain(HandlerChain&&) noexcept = default;
+    HandlerChain& operator=(HandlerChain&& other) noexcept {
+        destroyHandlers();
+        handlers_ = std::move(other.handlers_);
+        arena_ = std::move(other.arena_);
+        return *this;
+    }
+    ~HandlerChain() {
+        destroyHandlers();
+    }
+
+    LogMessageHandler& head() const {
+        return *handlers_.front();
+    }
+    // The first handler of type Handler in the chain; throws if there is none.
+    template <typename Handler>
+    Handler& get() const {
+        for (LogMessageHandler* handler : handlers_) {
+            if (auto* typed = dynamic_cast<Handler*>(handler)) {
+                return *typed;
+            }
+        }
+        throw std::out_of_range("HandlerChain has no handler of the requested type");
+    }
+    std::size_t size() const {
+        return handlers_.size();
+    }
+    void compile() {
+        head().compile();
+    }
+
+private:
+    std::vector<LogMessageHandler*> handlers_;
+    std::unique_ptr<std::byte, detail::ArenaDeleter> arena_;
+
+    HandlerChain() = default;
+
+    // Reverse chain order, like the members of a struct.
+    void destroyHandlers() {
+        for (auto handler = handlers_.rbegin(); handler != handlers_.rend(); ++handler) {
+            (*handler)->~LogMessageHandler();
+        }
+        handlers_.clear();
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "log_message.h"
+
+namespace detail {
+
+// Days since 1970-01-01 to a proleptic Gregorian date (H. Hinnant's algorithm),
+// used instead of gmtime so formatting stays thread-safe and allocation-free.
+inline void civilFromDays(std::int64_t days, int& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    auto doe = static_cast<unsigned>(days - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<int>(yoe + era * 400 + (month <= 2));
+}
+
+inline void appendTimestamp(std::string& out, std::chrono::system_clock::time_point timestamp) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(timestamp.time_since_epoch()).count();
+    std::int64_t seconds = us / 1000000 - (us % 1000000 < 0);
+    std::int64_t micros = us - seconds * 1000000;
+    std::int64_t days = seconds / 86400 - (seconds % 86400 < 0);
+    std::int64_t second_of_day = seconds - days * 86400;
+    int year;
+    unsigned month;
+    unsigned day;
+    civilFromDays(days, year, month, day);
+    char buffer[40];
+    int size = std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02uT%02d:%02d:%02d.%06dZ", year, month, day,
+                             static_cast<int>(second_of_day / 3600), static_cast<int>(second_of_day / 60 % 60),
+                             static_cast<int>(second_of_day % 60), static_cast<int>(micros));
+    out.append(buffer, static_cast<std::size_t>(size));
+}
+
+}  // namespace detail
+
+inline void appendFieldValue(std::string& out, const LogField& field) {
+    char buffer[32];
+    int size = 0;
+    switch (field.kind) {
+    case LogFieldKind::Int:
+        size = std::snprintf(buffer, sizeof(buffer), "%" PRId64, field.int_value);
+        break;
+    case LogFieldKind::UInt:
+        size = std::snprintf(buffer, sizeof(buffer), "%" PRIu64, field.uint_value);
+        break;
+    case LogFieldKind::Double:
+        size = std::snprintf(buffer, sizeof(buffer), "%g", field.double_value);
+        break;
+    case LogFieldKind::Bool:
+        out.append(field.bool_value ? "true" : "false");
+        return;
+    case LogFieldKind::String:
+        out.append(field.string_value);
+        return;
+    }
+    out.append(buffer, static_cast<std::size_t>(size));
+}
+
+// The message text alone. For a lazy message each "{}" in the format string
+// is replaced by the next positional argument; surplus placeholders are kept.
+inline void appendMessageText(std::string& out, const LogMessage& log) {
+    if (!log.lazy()) {
+        out.append(log.message());
+        return;
+    }
+    std::string_view format = log.message();
+    std::size_t position = 0;
+    log.forEachField([&](const LogField& field) {
+        if (field.key) {
+            return;
+        }
+        std::size_t placeholder = format.find("{}", position);
+        if (placeholder == std::string_view::npos) {
+            return;
+        }
+        out.append(format.substr(position, placeholder - position));
+        appendFieldValue(out, field);
+        position = placeholder + 2;
+    });
+    out.append(format.substr(position));
+}
+
+inline std::string messageText(const LogMessage& log) {
+    std::string text;
+    appendMessageText(text, log);
+    return text;
+}
+
+// Renders a message as one line of text. A plain message is just its text; a
+// structured one becomes
+//     2026-01-02T03:04:05.000006Z [thread 42] file.cpp:7 text key=value name="string"
+// with each part present only when the message carries it.
+inline void appendText(std::string& out, const LogMessage& log) {
+    if (!log.structured()) {
+        out.append(log.message());
+        return;
+    }
+    if (log.timestamp().time_since_epoch().count() != 0) {
+        detail::appendTimestamp(out, log.timestamp());
+        out.push_back(' ');
+    }
+    char buffer[32];
+    if (log.threadId() != 0) {
+        int size = std::snprintf(buffer, sizeof(buffer), "[thread %" PRIu64 "] ", log.threadId());
+        out.append(buffer, static_cast<std::size_t>(size));
+    }
+    if (log.where().file) {
+        int size = std::snprintf(buffer, sizeof(buffer), ":%u ", log.where().line);
+        out.append(log.where().file);
+        out.append(buffer, static_cast<std::size_t>(size));
+    }
+    appendMessageText(out, log);
+    log.forEachField([&](const LogField& field) {
+        if (!field.key) {
+            return;
+        }
+        out.push_back(' ');
+        out.append(field.key);
+        out.push_back('=');
+        bool quoted = field.kind == LogFieldKind::String;
+        if (quoted) {
+            out.push_back('"');
+        }
+        appendFieldValue(out, field);
+        if (quoted) {
+            out.push_back('"');
+        }
+    });
+}
+
+// The text appendText() produces. Plain messages are returned as they are;
+// structured ones are rendered into a thread-local buffer that is reused by
+// the next call on the same thread.
+inline std::string_view renderText(const LogMessage& log) {
+    if (!log.structured()) {
+        return log.message();
+    }
+    thread_local std::string text;
+    text.clear();
+    appendText(text, log);
+    return text;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "buffered_file_sink.h"
+#include "log_format.h"
+#include "log_message_handler.h"
+#include "stderr_writer.h"
+
+class ErrorHandler;
+class WarningHandler;
+
+class FatalErrorHandler final : public LogMessageHandler {
+public:
+    static constexpr LogMessageType kLogMessageType = LogMessageType::FatalError;
+
+    FatalErrorHandler() : LogMessageHandler(kLogMessageType) {
+    }
+
+    // Targets are flushed before a fatal message throws, if their
+    // FlushPolicy::flush_on_fatal is set.
+    void addFlushTarget(ErrorHandler* error_handler);
+    void addFlushTarget(WarningHandler* warning_handler);
+
+private:
+    std::vector<std::function<void()>> flush_targets_;
+
+    void operate(const LogMessage& log) const override;
+    HandleStatus tryOperate(const LogMessage& log) const override;
+    void flushTargets() const;
+};
+
+// Writes errors to a file that is truncated on construction and, with a
+// RotationPolicy, rotated in the background as it grows or ages. With
+// FileBackend::IoUring, flushed buffers are queued to the kernel instead of
+// written with a blocking call.
+class ErrorHandler final : public LogMessageHandler {
+public:
+    static constexpr LogMessageType kLogMessageType = LogMessageType::Error;
+
+    explicit ErrorHandler(const std::filesystem::path& filepath, FlushPolicy policy = {}, RotationPolicy rotation = {},
+                          FileBackend backend = FileBackend::Stream)
+    : LogMessageHandler(kLogMessageType), filepath_(filepath), sink_(filepath_, policy, true, rotation, backend) {
+    }
+
+    void flush() {
+        sink_.flush();
+    }
+    void flushOnFatal() {
+        if (sink_.policy().flush_on_fatal) {
+            sink_.flush();
+        }
+    }
+    std::uint64_t rotations() const {
+        return sink_.rotations();
+    }
+    FileBackend backend() const {
+        return sink_.backend();
+    }
+    std::uint64_t writeErrors() const {
+        return sink_.writeErrors();
+    }
+
+private:
+    std::filesystem::path filepath_;
+    mutable BufferedFileSink sink_;
+
+    void operate(const LogMessage& log) const override {
+        sink_.append(renderText(log), sink_.policy().flushesOn(log.type()));
+    }
+    void operateBatch(const LogMessage* const* logs, std::size_t count) const override {
+        sink_.appendLines(count, [logs](std::size_t i) { return renderText(*logs[i]); },
+                          sink_.policy().flushesOn(kLogMessageType));
+    }
+};
+
+// Warnings go to stderr through a StderrWriter, by default with
+// FlushPolicy::interactive() so a burst of warnings is written in a few calls
+// rather than one per line.
+class WarningHandler final : public LogMessageHandler {
+public:
+    static constexpr LogMessageType kLogMessageType = LogMessageType::Warning;
+
+    explicit WarningHandler(FlushPolicy policy = FlushPolicy::interactive())
+    : LogMessageHandler(kLogMessageType), writer_(policy) {
+    }
+
+    void flush() {
+        writer_.flush();
+    }
+    void flushOnFatal() {
+        if (writer_.policy().flush_on_fatal) {
+            writer_.flush();
+        }
+    }
+
+private:
+    mutable StderrWriter writer_;
+
+    // The whole line is assembled first and appended in one call, so warnings
+    // from concurrent threads never interleave mid-line.
+    void operate(const LogMessage& log) const override {
+        thread_local std::string line;
+        line.clear();
+        appendText(line, log);
+        line.push_back('\n');
+        writer_.append(line, writer_.policy().flushesOn(log.type()));
+    }
+    void operateBatch(const LogMessage* const* logs, std::size_t count) const override {
+        thread_local std::string lines;
+        lines.clear();
+        for (std::size_t i = 0; i < count; ++i) {
+            appendText(lines, *logs[i]);
+            lines.push_back('\n');
+        }
+        writer_.append(lines, writer_.policy().flushesOn(kLogMessageType));
+    }
+};
+
+class UnknownMessageHandler final : public LogMessageHandler {
+public:
+    static constexpr LogMessageType kLogMessageType = LogMessageType::UnknownMessage;
+
+    UnknownMessageHandler() : LogMessageHandler(kLogMessageType) {
+    }
+
+private:
+    void operate(const LogMessage& log) const override {
+        std::string what = "Unprocessed message: ";
+        appendMessageText(what, log);
+        throw std::runtime_error(what);
+    }
+    HandleStatus tryOperate(const LogMessage&) const override {
+        return HandleStatus::Unhandled;
+    }
+};
+
+// A handler with no state of its own is exactly the base: one cache line.
+static_assert(sizeof(UnknownMessageHandler) == sizeof(LogMessageHandler));
+
+inline void FatalErrorHandler::addFlushTarget(ErrorHandler* error_handler) {
+    flush_targets_.push_back([error_handler] { error_handler->flushOnFatal(); });
+}
+
+inline void FatalErrorHandler::addFlushTarget(WarningHandler* warning_handler) {
+    flush_targets_.push_back([warning_handler] { warning_handler->flushOnFatal(); });
+}
+
+inline void FatalErrorHandler::operate(const LogMessage& log) const {
+    flushTargets();
+    throw std::runtime_error(messageText(log));
+}
+
+inline HandleStatus FatalErrorHandler::tryOperate(const LogMessage&) const {
+    flushTargets();
+    return HandleStatus::Fatal;
+}
+
+inline void FatalErrorHandler::flushTargets() const {
+    for (const auto& flush_target : flush_targets_) {
+        flush_target();
+    }
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+enum class LogMessageType {
+    Warning,
+    Error,
+    FatalError,
+    UnknownMessage
+};
+
+constexpr std::size_t kLogMessageTypeCount = 4;
+
+// Bit i is set when the LogMessageType with underlying value i is included.
+using LogMessageTypeMask = std::uint32_t;
+
+constexpr LogMessageTypeMask kAllLogMessageTypes = (LogMessageTypeMask{1} << kLogMessageTypeCount) - 1;
+
+template <typename... Types>
+constexpr LogMessageTypeMask logMessageTypeMask(Types... types) {
+    return (LogMessageTypeMask{0} | ... | (LogMessageTypeMask{1} << static_cast<unsigned>(types)));
+}
+
+// All types from first to last inclusive, in declaration order.
+constexpr LogMessageTypeMask logMessageTypeRange(LogMessageType first, LogMessageType last) {
+    LogMessageTypeMask mask = 0;
+    for (auto type = static_cast<unsigned>(first); type <= static_cast<unsigned>(last); ++type) {
+        mask |= LogMessageTypeMask{1} << type;
+    }
+    return mask;
+}
+
+struct SourceLocation {
+    const char* file = nullptr;
+    unsigned line = 0;
+    const char* function = nullptr;
+};
+
+#define LOG_SOURCE_LOCATION (SourceLocation{__FILE__, __LINE__, __func__})
+
+enum class LogFieldKind : unsigned char {
+    Int,
+    UInt,
+    Double,
+    Bool,
+    String
+};
+
+// A decoded view of one key/value field; string values point into the message.
+struct LogField {
+    const char* key;
+    LogFieldKind kind;
+    union {
+        std::int64_t int_value;
+        std::uint64_t uint_value;
+        double double_value;
+        bool bool_value;
+    };
+    std::string_view string_value;
+};
+
+// The text lives in one of three places: borrowed from the caller (literals
+// and other static strings), copied into an inline buffer, or on the heap
+// when it is too long for the buffer or was handed over as a std::string.
+//
+// A message can also carry structured context: a timestamp, the source
+// location, the calling thread and typed key/value fields. Fields are encoded
+// back to back into the unused tail of the inline buffer (spilling to the heap
+// once it is full) and are only turned into text by a sink that writes them.
+class LogMessage {
+public:
+    static constexpr std::size_t kInlineCapacity = 256;
+
+    explicit LogMessage(LogMessageType type, std::string message)
+    : type_(type), storage_(Storage::Heap), heap_(std::move(message)) {
+    }
+    explicit LogMessage(LogMessageType type, const char* message)
+    : LogMessage(type, std::string_view(message), Storage::Inline) {
+    }
+
+    // The text must outlive the message and every copy of it.
+    static LogMessage borrowed(LogMessageType type, std::string_view message) {
+        return LogMessage(type, message, Storage::View);
+    }
+    static LogMessage copied(LogMessageType type, std::string_view message) {
+        return LogMessage(type, message, Storage::Inline);
+    }
+    // printf-style formatting straight into the inline buffer.
+    template <typename... Args>
+    static LogMessage formatted(LogMessageType type, const char* format, Args... args) {
+        if constexpr (sizeof...(Args) == 0) {
+            return copied(type, format);
+        } else {
+            LogMessage log(type, std::string_view(), Storage::Inline);
+            int size = std::snprintf(log.inline_, kInlineCapacity, format, args...);
+            if (size < 0) {
+                size = 0;
+            } else if (static_cast<std::size_t>(size) >= kInlineCapacity) {
+                log.storage_ = Storage::Heap;
+                log.heap_.resize(static_cast<std::size_t>(size));
+                std::snprintf(log.heap_.data(), log.heap_.size() + 1, format, args...);
+            }
+            log.inline_size_ = log.storage_ == Storage::Inline ? static_cast<std::size_t>(size) : 0;
+            log.arena_size_ = log.inline_size_;
+            return log;
+        }
+    }
+    // Defers formatting: the format string is borrowed (so it must be a
+    // literal) and the arguments are captured as positional fields. Each "{}"
+    // in format is replaced by the next argument only when a sink renders the
+    // message, so a message no handler claims is never formatted:
+    //     LogMessage::lazy(LogMessageType::Warning, "retry {} of {} for {}", attempt, limit, host);
+    template <typename... Args>
+    static LogMessage lazy(LogMessageType type, const char* format, Args... args) {
+        LogMessage log(type, format, Storage::View);
+        log.lazy_ = true;
+        (log.with(nullptr, args), ...);
+        return log;
+    }
+    // A structured record with borrowed text, stamped at the call site:
+    //     LogMessage::record(LogMessageType::Error, "write failed", LOG_SOURCE_LOCATION).with("fd", fd);
+    static LogMessage record(LogMessageType type, std::string_view message, SourceLocation where) {
+        LogMessage log(type, message, Storage::View);
+        log.stamp(where);
+        return log;
+    }
+
+    // Captures the current time and thread along with where.
+    LogMessage& stamp(SourceLocation where) {
+        return stamp(where, std::chrono::system_clock::now(),
+                     std::hash<std::thread::id>()(std::this_thread::get_id()));
+    }
+    // Restores a context captured elsewhere, e.g. when decoding a binary log.
+    LogMessage& stamp(SourceLocation where, std::chrono::system_clock::time_point timestamp, std::uint64_t thread_id) {
+        timestamp_ = timestamp;
+        thread_id_ = thread_id;
+        where_ = where;
+        return *this;
+    }
+
+    // Field keys are stored by pointer and must be string literals; lazy()
+    // stores its arguments as fields with a null key. String values are copied.
+    template <typename T>
+    LogMessage& with(const char* key, T value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            appendField(key, LogFieldKind::Bool, &value, 1);
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            auto v = static_cast<std::int64_t>(value);
+            appendField(key, LogFieldKind::Int, &v, sizeof(v));
+        } else if constexpr (std::is_integral_v<T>) {
+            auto v = static_cast<std::uint64_t>(value);
+            appendField(key, LogFieldKind::UInt, &v, sizeof(v));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            auto v = static_cast<double>(value);
+            appendField(key, LogFieldKind::Double, &v, sizeof(v));
+        } else {
+            std::string_view text(value);
+            auto size = static_cast<std::uint32_t>(text.size());
+            appendField(key, LogFieldKind::String, &size, sizeof(size), text);
+        }
+        return *this;
+    }
+
+    LogMessageType type() const {
+        return type_;
+    }
+    // For a lazy message this is the unformatted format string; render it
+    // with appendMessageText() instead.
+    std::string_view message() const {
+        switch (storage_) {
+        case Storage::View:
+            return view_;
+        case Storage::Inline:
+            return std::string_view(inline_, inline_size_);
+        case Storage::Heap:
+            break;
+        }
+        return heap_;
+    }
+
+    bool lazy() const {
+        return lazy_;
+    }
+    // True when there is anything beyond the text for a sink to render.
+    bool structured() const {
+        return has_fields_ || thread_id_ != 0 || where_.file
+            || timestamp_ != std::chrono::system_clock::time_point{};
+    }
+    // True when message() points at caller-owned text (borrowed(), record()
+    // and lazy()), which binary sinks can intern instead of copying.
+    bool borrowedText() const {
+        return storage_ == Storage::View;
+    }
+    std::chrono::system_clock::time_point timestamp() const {
+        return timestamp_;
+    }
+    std::uint64_t threadId() const {
+        return thread_id_;
+    }
+    const SourceLocation& where() const {
+        return where_;
+    }
+    template <typename Visit>
+    void forEachField(Visit visit) const {
+        decodeFields(std::string_view(inline_ + inline_size_, arena_size_ - inline_size_), visit);
+        decodeFields(field_overflow_, visit);
+    }
+
+private:
+    enum class Storage : unsigned char {
+        View,
+        Inline,
+        Heap
+    };
+
+    LogMessage(LogMessageType type, std::string_view message, Storage storage)
+    : type_(type), storage_(storage) {
+        if (storage_ == Storage::View) {
+            view_ = message;
+        } else if (message.size() < kInlineCapacity) {
+            message.copy(inline_, message.size());
+            inline_size_ = message.size();
+        } else {
+            storage_ = Storage::Heap;
+            heap_.assign(message);
+        }
+        arena_size_ = inline_size_;
+    }
+
+    // Encoding: kind byte, key pointer, fixed-size value, then for strings
+    // the bytes the value's length prefix announced.
+    void appendField(const char* key, LogFieldKind kind, const void* value, std::size_t value_size,
+                     std::string_view tail = {}) {
+        std::size_t size = 1 + sizeof(key) + value_size + tail.size();
+        char* at;
+        if (field_overflow_.empty() && arena_size_ + size <= kInlineCapacity) {
+            at = inline_ + arena_size_;
+            arena_size_ += size;
+        } else {
+            field_overflow_.resize(field_overflow_.size() + size);
+            at = field_overflow_.data() + field_overflow_.size() - size;
+        }
+        *at = static_cast<char>(kind);
+        std::memcpy(at + 1, &key, sizeof(key));
+        std::memcpy(at + 1 + sizeof(key), value, value_size);
+        tail.copy(at + 1 + sizeof(key) + value_size, tail.size());
+        has_fields_ = true;
+    }
+
+    template <typename Visit>
+    static void decodeFields(std::string_view bytes, Visit& visit) {
+        const char* at = bytes.data();
+        const char* end = at + bytes.size();
+        while (at < end) {
+            LogField field{};
+            field.kind = static_cast<LogFieldKind>(*at++);
+            std::memcpy(&field.key, at, sizeof(field.key));
+            at += sizeof(field.key);
+            switch (field.kind) {
+            case LogFieldKind::Bool:
+                field.bool_value = *at != 0;
+                at += 1;
+                break;
+            case LogFieldKind::String: {
+                std::uint32_t size;
+                std::memcpy(&size, at, sizeof(size));
+                at += sizeof(size);
+                field.string_value = std::string_view(at, size);
+                at += size;
+                break;
+            }
+            case LogFieldKind::Int:
+            case LogFieldKind::UInt:
+            case LogFieldKind::Double:
+                std::memcpy(&field.uint_value, at, sizeof(field.uint_value));
+                at += sizeof(field.uint_value);
+                break;
+            }
+            visit(field);
+        }
+    }
+
+    LogMessageType type_;
+    Storage storage_;
+    bool has_fields_ = false;
+    bool lazy_ = false;
+    std::size_t inline_size_ = 0;
+    std::size_t arena_size_ = 0;
+    std::string_view view_;
+    std::string heap_;
+    std::chrono::system_clock::time_point timestamp_{};
+    std::uint64_t thread_id_ = 0;
+    SourceLocation where_;
+    std::string field_overflow_;
+    char inline_[kInlineCapacity];
+};
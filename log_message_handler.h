@@ -0,0 +1,402 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "log_message.h"
+
+enum class HandleStatus {
+    Handled,
+    Fatal,
+    Unhandled
+};
+
+namespace detail {
+struct HandlerAccess;
+}
+
+// A cheap filter evaluated after the type check; a handler whose predicate
+// rejects a message is passed over as if it did not claim the type.
+using LogMessagePredicate = bool (*)(const LogMessage& log);
+
+// Concurrency model: a chain is wired (setNextHandler, setPredicate, compile)
+// by one thread and is immutable afterwards. handle() may then be called from
+// any number of threads at once; each handler's operate() is responsible for
+// making its own sink thread-safe. To change routing while other threads are
+// logging, build a new chain and publish it through SwappableChain.
+//
+// Layout: handle() on an uncompiled chain reads only the vtable pointer,
+// next_handler_, filter_ and types_ of each handler it passes, so those come
+// first and the whole base fits in one cache line. The compiled routes are
+// allocated separately by compile() and only touched at the head.
+class LogMessageHandler {
+public:
+    virtual ~LogMessageHandler() = default;
+
+    // Throws std::invalid_argument if the new link would close a loop. The
+    // check walks the chain downstream of next_handler, so building a chain
+    // from its tail towards its head is quadratic; link head first instead.
+    void setNextHandler(LogMessageHandler* next_handler) {
+        for (const LogMessageHandler* handler = next_handler; handler; handler = handler->next_handler_) {
+            if (handler == this) {
+                throw std::invalid_argument("setNextHandler would create a cycle in the handler chain");
+            }
+        }
+        next_handler_ = next_handler;
+        routes_.reset();
+    }
+    // Like the links, the predicate is part of the chain's shape: recompile
+    // the head of a compiled chain after changing it. On a handler with its
+    // own filter (RateLimitHandler, DedupHandler) the predicate runs first,
+    // and the filter only sees messages it accepts.
+    void setPredicate(LogMessagePredicate predicate) {
+        predicate_ = predicate;
+        updateFilter();
+    }
+    // In broadcast mode every handler that claims a message operates on it,
+    // in chain order, instead of only the first. An exception thrown by one
+    // of them stops the rest. Applies to traversals starting at this handler.
+    // Handlers that work by claiming messages, such as RateLimitHandler and
+    // DedupHandler, therefore hold nothing back in this mode.
+    void setBroadcast(bool broadcast) {
+        broadcast_ = broadcast;
+        routes_.reset();
+    }
+    // Bounds how many handlers a traversal starting at this handler visits.
+    // Exceeding it makes handle() throw std::length_error and tryHandle()
+    // report Unhandled; compile() ignores handlers beyond the limit.
+    void setMaxDepth(std::size_t max_depth) {
+        max_depth_ = max_depth;
+        routes_.reset();
+    }
+    // Freezes the chain starting at this handler. For each LogMessageType it
+    // records the handlers claiming that type, in chain order, up to and
+    // including the first one without a predicate; later handlers can never
+    // be reached for that type. In broadcast mode the list holds every
+    // claiming handler, so fan-out is a walk over a short array. handle()
+    // then scans only that list and never walks the links. The chain must not
+    // be rewired afterwards; call compile() again if it is.
+    void compile() {
+        auto routes = std::make_unique<RouteTable>();
+        LogMessageTypeMask open_types = kAllLogMessageTypes;
+        std::size_t depth = 0;
+        for (LogMessageHandler* handler = this; handler && open_types && depth < max_depth_;
+             handler = handler->next_handler_, ++depth) {
+            LogMessageTypeMask types = handler->types_ & open_types;
+            for (std::size_t index = 0; index < kLogMessageTypeCount; ++index) {
+                if (types & (LogMessageTypeMask{1} << index)) {
+                    (*routes)[index].push_back(Route{handler, handler->filter_});
+                }
+            }
+            if (!handler->filter_ && !broadcast_) {
+                open_types &= ~types;
+            }
+        }
+        routes_ = std::move(routes);
+    }
+    // The types this handler claims, fixed at construction.
+    LogMessageTypeMask logMessageTypes() const {
+        return types_;
+    }
+    // Handles a batch in one call: messages are grouped by type in a single
+    // pass, and each run of consecutive messages routed to the same handler
+    // is passed to it through one operateBatch() call. Groups are dispatched
+    // in LogMessageType order and keep their relative order within a group;
+    // a run never spans two groups, so anything a filter sends down the chain
+    // while routing a group (a dedup summary) follows the earlier groups.
+    void handle(const LogMessage* logs, std::size_t count) {
+        thread_local std::vector<const LogMessage*> cached_order;
+        std::vector<const LogMessage*> order = std::move(cached_order);
+        std::array<std::size_t, kLogMessageTypeCount + 1> offsets{};
+        for (std::size_t i = 0; i < count; ++i) {
+            auto index = static_cast<std::size_t>(logs[i].type());
+            if (index < kLogMessageTypeCount) {
+                ++offsets[index + 1];
+            }
+        }
+        for (std::size_t type = 0; type < kLogMessageTypeCount; ++type) {
+            offsets[type + 1] += offsets[type];
+        }
+        order.resize(offsets[kLogMessageTypeCount]);
+        std::array<std::size_t, kLogMessageTypeCount> cursor{};
+        std::copy(offsets.begin(), offsets.end() - 1, cursor.begin());
+        for (std::size_t i = 0; i < count; ++i) {
+            auto index = static_cast<std::size_t>(logs[i].type());
+            if (index < kLogMessageTypeCount) {
+                order[cursor[index]++] = &logs[i];
+            }
+        }
+        if (broadcast_) {
+            broadcastBatch(order, offsets);
+            cached_order = std::move(order);
+            return;
+        }
+        std::size_t run_begin = 0;
+        LogMessageHandler* run_handler = nullptr;
+        for (std::size_t i = 0; i <= order.size(); ++i) {
+            // Close the last run of a group before routing the next group.
+            bool group_end = i == order.size() || (i > 0 && order[i]->type() != order[i - 1]->type());
+            if (group_end && run_handler) {
+                run_handler->operateBatch(order.data() + run_begin, i - run_begin);
+                run_handler = nullptr;
+            }
+            if (i == order.size()) {
+                break;
+            }
+            LogMessageHandler* handler = findHandlerOrThrow(*order[i]);
+            if (handler != run_handler) {
+                if (run_handler) {
+                    run_handler->operateBatch(order.data() + run_begin, i - run_begin);
+                }
+                run_begin = i;
+                run_handler = handler;
+            }
+        }
+        cached_order = std::move(order);
+    }
+    void handle(const std::vector<LogMessage>& logs) {
+        handle(logs.data(), logs.size());
+    }
+    // Non-throwing alternative to handle(): handlers that would throw report
+    // Fatal or Unhandled instead, and a message no handler claims is Unhandled.
+    // In broadcast mode the result is Fatal if any handler reported Fatal,
+    // otherwise Handled if any handler handled the message.
+    HandleStatus tryHandle(const LogMessage& log) {
+        bool depth_exceeded = false;
+        if (broadcast_) {
+            HandleStatus result = HandleStatus::Unhandled;
+            forEachMatch(log, depth_exceeded, [&](LogMessageHandler* handler) {
+                HandleStatus status = handler->tryOperate(log);
+                if (status == HandleStatus::Fatal) {
+                    result = HandleStatus::Fatal;
+                } else if (status == HandleStatus::Handled && result == HandleStatus::Unhandled) {
+                    result = HandleStatus::Handled;
+                }
+            });
+            return result;
+        }
+        LogMessageHandler* handler = findHandler(log, depth_exceeded);
+        return handler ? handler->tryOperate(log) : HandleStatus::Unhandled;
+    }
+    void handle(const LogMessage& log) {
+        if (broadcast_) {
+            bool depth_exceeded = false;
+            forEachMatch(log, depth_exceeded, [&](LogMessageHandler* handler) { handler->operate(log); });
+            throwIfExceeded(depth_exceeded);
+            return;
+        }
+        if (LogMessageHandler* handler = findHandlerOrThrow(log)) {
+            handler->operate(log);
+        }
+    }
+
+protected:
+    explicit LogMessageHandler(LogMessageType type) : types_(logMessageTypeMask(type)) {
+    }
+    explicit LogMessageHandler(LogMessageTypeMask types) : types_(types) {
+    }
+
+    // Like a predicate, but called with the handler itself, for handlers whose
+    // claim depends on their own state (rate limits, deduplication). It is
+    // layered under any predicate set with setPredicate().
+    using Filter = bool (*)(const LogMessageHandler& self, const LogMessage& log);
+
+    void setFilter(Filter filter) {
+        own_filter_ = filter;
+        updateFilter();
+    }
+    LogMessageHandler* nextHandler() const {
+        return next_handler_;
+    }
+
+private:
+    friend struct detail::HandlerAccess;
+
+    struct Route {
+        LogMessageHandler* handler;
+        Filter filter;
+    };
+
+    using RouteTable = std::array<std::vector<Route>, kLogMessageTypeCount>;
+
+    // Hot: read at every hop of an uncompiled traversal.
+    LogMessageHandler* next_handler_ = nullptr;
+    Filter filter_ = nullptr;
+    LogMessageTypeMask types_;
+    bool broadcast_ = false;
+    // Cold: read once per traversal, at its head.
+    std::size_t max_depth_ = std::numeric_limits<std::size_t>::max();
+    std::unique_ptr<const RouteTable> routes_;
+    LogMessagePredicate predicate_ = nullptr;
+    Filter own_filter_ = nullptr;
+
+    static bool applyPredicate(const LogMessageHandler& self, const LogMessage& log) {
+        return self.predicate_(log);
+    }
+    static bool applyPredicateAndFilter(const LogMessageHandler& self, const LogMessage& log) {
+        return self.predicate_(log) && self.own_filter_(self, log);
+    }
+    // filter_ is the one check routing makes; it combines both.
+    void updateFilter() {
+        if (predicate_ && own_filter_) {
+            filter_ = &LogMessageHandler::applyPredicateAndFilter;
+        } else if (predicate_) {
+            filter_ = &LogMessageHandler::applyPredicate;
+        } else {
+            filter_ = own_filter_;
+        }
+    }
+
+    // Walks the chain with an explicit cursor rather than recursing, so the
+    // stack does not grow with the length of the chain.
+    LogMessageHandler* findHandler(const LogMessage& log, bool& depth_exceeded) {
+        auto index = static_cast<std::size_t>(log.type());
+        if (index >= kLogMessageTypeCount) {
+            return nullptr;
+        }
+        if (routes_) {
+            for (const Route& route : (*routes_)[index]) {
+                if (!route.filter || route.filter(*route.handler, log)) {
+                    return route.handler;
+                }
+            }
+            return nullptr;
+        }
+        LogMessageTypeMask type_bit = LogMessageTypeMask{1} << index;
+        std::size_t depth = 0;
+        for (LogMessageHandler* handler = this; handler; handler = handler->next_handler_) {
+            if (depth++ == max_depth_) {
+                depth_exceeded = true;
+                return nullptr;
+            }
+            if ((handler->types_ & type_bit) && (!handler->filter_ || handler->filter_(*handler, log))) {
+                return handler;
+            }
+        }
+        return nullptr;
+    }
+    LogMessageHandler* findHandlerOrThrow(const LogMessage& log) {
+        bool depth_exceeded = false;
+        LogMessageHandler* handler = findHandler(log, depth_exceeded);
+        throwIfExceeded(depth_exceeded);
+        return handler;
+    }
+    static void throwIfExceeded(bool depth_exceeded) {
+        if (depth_exceeded) {
+            throw std::length_error("handler chain is longer than its max depth");
+        }
+    }
+
+    // Broadcast counterpart of findHandler(): calls visit for every handler
+    // that claims log, in chain order.
+    template <typename Visit>
+    void forEachMatch(const LogMessage& log, bool& depth_exceeded, Visit visit) {
+        auto index = static_cast<std::size_t>(log.type());
+        if (index >= kLogMessageTypeCount) {
+            return;
+        }
+        if (routes_) {
+            for (const Route& route : (*routes_)[index]) {
+                if (!route.filter || route.filter(*route.handler, log)) {
+                    visit(route.handler);
+                }
+            }
+            return;
+        }
+        LogMessageTypeMask type_bit = LogMessageTypeMask{1} << index;
+        std::size_t depth = 0;
+        for (LogMessageHandler* handler = this; handler; handler = handler->next_handler_) {
+            if (depth++ == max_depth_) {
+                depth_exceeded = true;
+                return;
+            }
+            if ((handler->types_ & type_bit) && (!handler->filter_ || handler->filter_(*handler, log))) {
+                visit(handler);
+            }
+        }
+    }
+
+    // Each handler receives, in one operateBatch() call per type, the part of
+    // the group its predicate accepts.
+    void broadcastBatch(const std::vector<const LogMessage*>& order,
+                        const std::array<std::size_t, kLogMessageTypeCount + 1>& offsets) {
+        std::vector<Route> walked;
+        std::vector<const LogMessage*> accepted;
+        for (std::size_t type = 0; type < kLogMessageTypeCount; ++type) {
+            const LogMessage* const* group = order.data() + offsets[type];
+            std::size_t size = offsets[type + 1] - offsets[type];
+            if (size == 0) {
+                continue;
+            }
+            const std::vector<Route>& routes = routes_ ? (*routes_)[type] : walked;
+            if (!routes_) {
+                walked.clear();
+                LogMessageTypeMask type_bit = LogMessageTypeMask{1} << type;
+                std::size_t depth = 0;
+                for (LogMessageHandler* handler = this; handler; handler = handler->next_handler_) {
+                    throwIfExceeded(depth++ == max_depth_);
+                    if (handler->types_ & type_bit) {
+                        walked.push_back(Route{handler, handler->filter_});
+                    }
+                }
+            }
+            for (const Route& route : routes) {
+                if (!route.filter) {
+                    route.handler->operateBatch(group, size);
+                    continue;
+                }
+                accepted.clear();
+                std::copy_if(group, group + size, std::back_inserter(accepted),
+                             [&route](const LogMessage* log) { return route.filter(*route.handler, *log); });
+                if (!accepted.empty()) {
+                    route.handler->operateBatch(accepted.data(), accepted.size());
+                }
+            }
+        }
+    }
+
+    virtual void operate(const LogMessage& log) const = 0;
+    virtual HandleStatus tryOperate(const LogMessage& log) const {
+        operate(log);
+        return HandleStatus::Handled;
+    }
+    virtual void operateBatch(const LogMessage* const* logs, std::size_t count) const {
+        for (std::size_t i = 0; i < count; ++i) {
+            operate(*logs[i]);
+        }
+    }
+};
+
+static_assert(sizeof(LogMessageHandler) <= 64, "LogMessageHandler should fit in one cache line");
+
+namespace detail {
+
+// The one way into a handler for code that routes without the links, such as
+// StaticChain, so handlers need not befriend it. operate() is called through
+// the base, which the compiler resolves statically for a final handler.
+struct HandlerAccess {
+    // The handler's predicate and filter; the type check is the caller's.
+    static bool accepts(const LogMessageHandler& handler, const LogMessage& log) {
+        return !handler.filter_ || handler.filter_(handler, log);
+    }
+    static void operate(const LogMessageHandler& handler, const LogMessage& log) {
+        handler.operate(log);
+    }
+};
+
+}  // namespace detail
+
+// Base for handlers that claim a set or range of types, e.g.
+// logMessageTypeRange(LogMessageType::Warning, LogMessageType::FatalError).
+class MultiTypeHandler : public LogMessageHandler {
+public:
+    explicit MultiTypeHandler(LogMessageTypeMask types) : LogMessageHandler(types) {
+    }
+};
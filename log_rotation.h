@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef LOG_ROTATION_ZLIB
+#include <zlib.h>
+#endif
+
+// When a log file is rotated: error.txt becomes error.txt.1, error.txt.1
+// becomes error.txt.2 and so on, and a fresh error.txt is opened. Rotated
+// files are gzip-compressed (error.txt.1.gz) when built with zlib
+// (LOG_ROTATION_ZLIB), and kept as they are otherwise.
+struct RotationPolicy {
+    // Rotate once the file holds this many bytes; 0 disables.
+    std::size_t max_file_bytes = 0;
+    // Rotate once the file is this old, even if nothing is being written; 0
+    // disables. A file still empty by then is kept and starts aging again, so
+    // an idle log does not push its history out with empty archives.
+    std::chrono::seconds max_age{0};
+    // Rotated files to keep; the oldest beyond this is deleted.
+    std::size_t max_files = 5;
+    bool compress = true;
+
+    bool enabled() const {
+        return max_file_bytes > 0 || max_age.count() > 0;
+    }
+};
+
+namespace detail {
+
+inline std::filesystem::path rotatedPath(const std::filesystem::path& path, std::size_t index,
+                                         const char* extension = "") {
+    std::filesystem::path rotated = path;
+    rotated += "." + std::to_string(index) + extension;
+    return rotated;
+}
+
+// Gzips source into target and removes source. On failure the partial target
+// is removed and source is left in place.
+inline bool compressFile(const std::filesystem::path& source, const std::filesystem::path& target) {
+#ifdef LOG_ROTATION_ZLIB
+    std::FILE* in = std::fopen(source.string().c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    gzFile out = gzopen(target.string().c_str(), "wb6");
+    bool ok = out != nullptr;
+    std::vector<char> chunk(64 * 1024);
+    while (ok) {
+        std::size_t size = std::fread(chunk.data(), 1, chunk.size(), in);
+        if (size == 0) {
+            ok = !std::ferror(in);
+            break;
+        }
+        ok = gzwrite(out, chunk.data(), static_cast<unsigned>(size)) == static_cast<int>(size);
+    }
+    if (out && gzclose(out) != Z_OK) {
+        ok = false;
+    }
+    std::fclose(in);
+    std::error_code error;
+    std::filesystem::remove(ok ? source : target, error);
+    return ok;
+#else
+    (void)source;
+    (void)target;
+    return false;
+#endif
+}
+
+}  // namespace detail
+
+// Does the slow parts of rotation on its own thread: renaming the archives,
+// opening the next file and compressing the previous one. Writers are only
+// held up while `reopen` swaps the new stream in under their lock. The live
+// file is renamed while still open (POSIX semantics), so lines written
+// between the rename and the swap land at the end of the rotated file.
+class FileRotator {
+public:
+    // reopen must open a fresh file at path and swap it in for the writers.
+    FileRotator(std::filesystem::path path, RotationPolicy policy, std::function<void()> reopen)
+    : path_(std::move(path)), policy_(policy), reopen_(std::move(reopen)),
+      file_bytes_(sizeOf(path_)), opened_at_(std::chrono::steady_clock::now()), thread_([this] { run(); }) {
+    }
+    FileRotator(const FileRotator&) = delete;
+    FileRotator& operator=(const FileRotator&) = delete;
+    ~FileRotator() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    // Called by writers with the size of the current file; never blocks on
+    // the rotation itself.
+    void noteSize(std::size_t file_bytes) {
+        file_bytes_.store(file_bytes, std::memory_order_relaxed);
+        if (policy_.max_file_bytes == 0 || file_bytes < policy_.max_file_bytes
+            || requested_.exchange(true, std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_.notify_one();
+    }
+    std::uint64_t rotations() const {
+        return rotations_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::filesystem::path path_;
+    RotationPolicy policy_;
+    std::function<void()> reopen_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::atomic<bool> requested_{false};
+    std::atomic<std::size_t> file_bytes_;
+    std::atomic<std::uint64_t> rotations_{0};
+    std::chrono::steady_clock::time_point opened_at_;
+    std::thread thread_;
+
+    static std::size_t sizeOf(const std::filesystem::path& path) {
+        std::error_code error;
+        std::uintmax_t size = std::filesystem::file_size(path, error);
+        return error ? 0 : static_cast<std::size_t>(size);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            auto due = [this] {
+                return stopping_ || requested_.load(std::memory_order_relaxed)
+                    || (policy_.max_age.count() > 0 && std::chrono::steady_clock::now() - opened_at_ >= policy_.max_age);
+            };
+            if (policy_.max_age.count() > 0) {
+                wake_.wait_until(lock, opened_at_ + policy_.max_age, due);
+            } else {
+                wake_.wait(lock, due);
+            }
+            if (stopping_) {
+                break;
+            }
+            if (!requested_.load(std::memory_order_relaxed) && file_bytes_.load(std::memory_order_relaxed) == 0) {
+                opened_at_ = std::chrono::steady_clock::now();
+                continue;
+            }
+            lock.unlock();
+            rotate();
+            lock.lock();
+        }
+    }
+
+    void rotate() {
+        std::error_code error;
+        for (std::size_t index = policy_.max_files; index >= 1; --index) {
+            for (const char* extension : {"", ".gz"}) {
+                std::filesystem::path from = detail::rotatedPath(path_, index, extension);
+                if (index == policy_.max_files) {
+                    std::filesystem::remove(from, error);
+                } else if (std::filesystem::exists(from, error)) {
+                    std::filesystem::rename(from, detail::rotatedPath(path_, index + 1, extension), error);
+                }
+            }
+        }
+        std::filesystem::path rotated = detail::rotatedPath(path_, 1);
+        if (policy_.max_files > 0) {
+            std::filesystem::rename(path_, rotated, error);
+        }
+        reopen_();
+        file_bytes_.store(0, std::memory_order_relaxed);
+        opened_at_ = std::chrono::steady_clock::now();
+        requested_.store(false, std::memory_order_relaxed);
+        rotations_.fetch_add(1, std::memory_order_relaxed);
+        if (policy_.max_files > 0 && policy_.compress) {
+            detail::compressFile(rotated, detail::rotatedPath(path_, 1, ".gz"));
+        }
+    }
+};
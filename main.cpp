@@ -4,126 +4,27 @@
 #include <iostream>
 #include <memory>
 
-
-enum class LogMessageType {
-    Warning,
-    Error,
-    FatalError,
-    UnknownMessage
-};
-
-class LogMessage {
-public:
-    explicit LogMessage(LogMessageType type, std::string message)
-    : type_(type), message_(std::move(message)) {
-    }
-
-    LogMessageType type() const {
-        return type_;
-    }
-    const std::string& message() const {
-        return message_;
-    }
-
-private:
-    LogMessageType type_;
-    std::string message_;
-};
-
-class LogMessageHandler {
-public:
-    void setNextHandler(LogMessageHandler* next_handler) {
-        next_handler_ = next_handler;
-    }
-    void handle(const LogMessage& log) {
-        if (log.type() == getLogMessageType()) {
-            operate(log);
-        } else if (next_handler_) {
-            next_handler_->handle(log);
-        }
-    }
-
-private:
-    LogMessageHandler* next_handler_ = nullptr;
-
-    virtual void operate(const LogMessage& log) const = 0;
-    virtual LogMessageType getLogMessageType() const = 0;
-};
-
-class FatalErrorHandler : public LogMessageHandler {
-private:
-    LogMessageHandler* next_handler_ = nullptr;
-
-    void operate(const LogMessage& log) const override {
-        throw std::runtime_error(log.message());
-    }
-
-    LogMessageType getLogMessageType() const override {
-        return LogMessageType::FatalError;
-    }
-};
-
-class ErrorHandler : public LogMessageHandler {
-public:
-    explicit ErrorHandler(const std::filesystem::path& filepath) : filepath_(filepath) {
-        std::ofstream ofs(filepath_);
-        if (ofs.is_open()) {
-            ofs.close();
-        }
-    }
-
-private:
-    std::filesystem::path filepath_;
-
-    void operate(const LogMessage& log) const override {
-        std::ofstream ofs(filepath_);
-        if (ofs.is_open()) {
-            ofs << log.message() << std::endl;
-            ofs.close();
-        }
-    }
-
-    LogMessageType getLogMessageType() const override{
-        return LogMessageType::Error;
-    }
-};
-
-class WarningHandler : public LogMessageHandler {
-private:
-    LogMessageHandler* next_handler_ = nullptr;
-
-    void operate(const LogMessage& log) const override {
-        std::cerr << log.message() << std::endl;
-    }
-
-    LogMessageType getLogMessageType() const override{
-        return LogMessageType::Warning;
-    }
-};
-
-class UnknownMessageHandler : public LogMessageHandler {
-private:
-    LogMessageHandler* next_handler_ = nullptr;
-
-    void operate(const LogMessage& log) const override {
-        throw std::runtime_error("Unprocessed message: " + log.message());
-    }
-
-    LogMessageType getLogMessageType() const override{
-        return LogMessageType::UnknownMessage;
-    }
-};
+#include "async_logger.h"
+#include "handler_chain.h"
+#include "log_handlers.h"
+#include "static_chain.h"
+#include "swappable_chain.h"
 
 int main() {
     std::filesystem::path p = "C:\\Users\\Fedot\\Desktop\\cpp\\workspace_net\\net_6_3_3_chain_of_responsibility\\error.txt";
-    LogMessageHandler* main_handler = new FatalErrorHandler();
-    LogMessageHandler* error_h = new ErrorHandler(p);
-    LogMessageHandler* warning_h = new WarningHandler();
-    LogMessageHandler* unknown_h = new UnknownMessageHandler();
-
-    main_handler->setNextHandler(error_h);
-    error_h->setNextHandler(warning_h);
-    warning_h->setNextHandler(unknown_h);
+    HandlerChain chain = HandlerChain::Builder()
+                             .add<FatalErrorHandler>()
+                             .add<ErrorHandler>(p)
+                             .add<WarningHandler>()
+                             .add<UnknownMessageHandler>()
+                             .build();
+    FatalErrorHandler* main_handler = &chain.get<FatalErrorHandler>();
+    ErrorHandler* error_h = &chain.get<ErrorHandler>();
+    WarningHandler* warning_h = &chain.get<WarningHandler>();
+
+    main_handler->addFlushTarget(error_h);
+    main_handler->addFlushTarget(warning_h);
+    main_handler->compile();
 
     {
         LogMessage log(LogMessageType::UnknownMessage, "some unknown message");
@@ -140,6 +41,7 @@ int main() {
     {
         LogMessage log(LogMessageType::Error, "some_error");
         main_handler->handle(log);
+        error_h->flush();
         std::ifstream ifs(p);
         std::string m;
         if (ifs.is_open()) {
@@ -156,11 +58,50 @@ int main() {
             std::cout << e.what() << std:: endl;
         }
     }
-
-    delete unknown_h;
-    delete warning_h;
-    delete error_h;
-    delete main_handler;
+    {
+        main_handler->handle(LogMessage::record(LogMessageType::Warning, "structured warning", LOG_SOURCE_LOCATION)
+                                 .with("attempt", 3)
+                                 .with("path", p.string()));
+    }
+    {
+        main_handler->handle(LogMessage::lazy(LogMessageType::Warning, "lazy warning {} of {}", 1, 2));
+    }
+    {
+        LogMessage log(LogMessageType::UnknownMessage, "some unknown message");
+        if (main_handler->tryHandle(log) == HandleStatus::Unhandled) {
+            std::cout << "Unhandled message: " << log.message() << std::endl;
+        }
+    }
+    {
+        AsyncLogger async_logger(*main_handler, 1024, BackpressurePolicy::Block,
+                                 [](const LogMessage&, const std::exception& e) {
+                                     std::cout << e.what() << std::endl;
+                                 });
+        async_logger.submit(LogMessage(LogMessageType::Warning, "async warning"));
+        async_logger.submit(LogMessage(LogMessageType::UnknownMessage, "async unknown message"));
+        async_logger.flush();
+    }
+    {
+        SwappableChain swappable(HandlerChain::Builder().add<UnknownMessageHandler>().build());
+        LogMessage log(LogMessageType::Warning, "verbose warning");
+        if (swappable.tryHandle(log) == HandleStatus::Unhandled) {
+            std::cout << "Warnings are off: " << log.message() << std::endl;
+        }
+        swappable.swap(HandlerChain::Builder().add<WarningHandler>().add<UnknownMessageHandler>().build());
+        swappable.handle(log);
+    }
+    {
+        std::filesystem::path static_p = p;
+        static_p.replace_filename("static_error.txt");
+        StaticChain<FatalErrorHandler, ErrorHandler, WarningHandler, UnknownMessageHandler> static_chain(
+            std::tuple<>(), std::make_tuple(static_p), std::tuple<>(), std::tuple<>());
+        static_chain.handle(LogMessage(LogMessageType::Warning, "static warning"));
+        try {
+            static_chain.handle(LogMessage(LogMessageType::UnknownMessage, "static unknown message"));
+        } catch (const std::runtime_error& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
 
     return 0;
 }
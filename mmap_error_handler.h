@@ -0,0 +1,256 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "log_format.h"
+#include "log_message_handler.h"
+
+// On-disk layout: a fixed header followed by `capacity` bytes of data used as
+// a circular buffer. head and tail are monotonically increasing logical byte
+// positions (physical offset = position % capacity); [tail, head) holds whole
+// records. Every record starts with an 8-byte MmapRecordHeader and is padded
+// to 8 bytes. A record never straddles the end of the data region: the rest of
+// the region is filled with a padding record instead.
+struct MmapRingHeader {
+    static constexpr char kMagic[8] = {'E', 'R', 'R', 'R', 'I', 'N', 'G', '1'};
+    static constexpr std::uint32_t kVersion = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::uint64_t capacity;
+    std::atomic<std::uint64_t> head;
+    std::atomic<std::uint64_t> tail;
+    std::atomic<std::uint64_t> records;
+};
+
+struct MmapRecordHeader {
+    static constexpr std::uint16_t kPadding = 0xFFFF;
+
+    std::uint32_t payload_size;
+    std::uint16_t kind;
+    std::uint16_t reserved;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "ring positions must be lock-free in shared memory");
+static_assert(sizeof(MmapRecordHeader) == 8, "record header must stay 8 bytes");
+
+class MmapMapping {
+public:
+    MmapMapping(const std::filesystem::path& filepath, std::size_t size, bool writable) {
+        fd_ = ::open(filepath.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + filepath.string());
+        }
+        if (!writable) {
+            struct stat st {};
+            if (::fstat(fd_, &st) != 0) {
+                fail("fstat " + filepath.string());
+            }
+            size = static_cast<std::size_t>(st.st_size);
+        } else if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+            fail("ftruncate " + filepath.string());
+        }
+        if (size < sizeof(MmapRingHeader)) {
+            ::close(fd_);
+            throw std::system_error(EINVAL, std::generic_category(), "ring file too small: " + filepath.string());
+        }
+        void* data = ::mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED) {
+            fail("mmap " + filepath.string());
+        }
+        data_ = static_cast<char*>(data);
+        size_ = size;
+    }
+    MmapMapping(const MmapMapping&) = delete;
+    MmapMapping& operator=(const MmapMapping&) = delete;
+    ~MmapMapping() {
+        ::munmap(data_, size_);
+        ::close(fd_);
+    }
+
+    char* data() const {
+        return data_;
+    }
+    std::size_t size() const {
+        return size_;
+    }
+    void sync() const {
+        ::msync(data_, size_, MS_ASYNC);
+    }
+
+private:
+    int fd_ = -1;
+    char* data_ = nullptr;
+    std::size_t size_ = 0;
+
+    [[noreturn]] void fail(const std::string& what) {
+        int error = errno;
+        ::close(fd_);
+        throw std::system_error(error, std::generic_category(), what);
+    }
+};
+
+// Appends records into a preallocated, memory-mapped ring. A record becomes
+// visible only once head is published after its bytes are stored, so a crash
+// mid-append never exposes a torn record. An existing ring of the same
+// capacity is reopened and appended to.
+class MmapRingWriter {
+public:
+    MmapRingWriter(const std::filesystem::path& filepath, std::size_t capacity)
+    : mapping_(filepath, sizeof(MmapRingHeader) + dataSize(capacity), true),
+      header_(reinterpret_cast<MmapRingHeader*>(mapping_.data())),
+      data_(mapping_.data() + sizeof(MmapRingHeader)) {
+        if (std::memcmp(header_->magic, MmapRingHeader::kMagic, sizeof(header_->magic)) != 0
+            || header_->version != MmapRingHeader::kVersion || header_->capacity != dataSize(capacity)) {
+            header_->version = MmapRingHeader::kVersion;
+            header_->header_size = sizeof(MmapRingHeader);
+            header_->capacity = dataSize(capacity);
+            header_->head.store(0, std::memory_order_relaxed);
+            header_->tail.store(0, std::memory_order_relaxed);
+            header_->records.store(0, std::memory_order_relaxed);
+            std::memcpy(header_->magic, MmapRingHeader::kMagic, sizeof(header_->magic));
+        }
+    }
+
+    void append(std::uint16_t kind, std::string_view payload) {
+        std::uint64_t capacity = header_->capacity;
+        if (payload.size() > capacity - sizeof(MmapRecordHeader)) {
+            payload = payload.substr(0, capacity - sizeof(MmapRecordHeader));
+        }
+        std::uint64_t size = roundUp(sizeof(MmapRecordHeader) + payload.size());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::uint64_t head = header_->head.load(std::memory_order_relaxed);
+        std::uint64_t room = capacity - head % capacity;
+        if (room < size) {
+            makeRoom(head, room);
+            store(head, MmapRecordHeader::kPadding, room - sizeof(MmapRecordHeader), {});
+            head += room;
+        }
+        makeRoom(head, size);
+        store(head, kind, payload.size(), payload);
+        header_->records.fetch_add(1, std::memory_order_relaxed);
+        header_->head.store(head + size, std::memory_order_release);
+    }
+    void sync() const {
+        mapping_.sync();
+    }
+
+private:
+    MmapMapping mapping_;
+    MmapRingHeader* header_;
+    char* data_;
+    std::mutex mutex_;
+
+    static std::uint64_t roundUp(std::uint64_t size) {
+        return (size + 7) & ~std::uint64_t{7};
+    }
+    static std::uint64_t dataSize(std::size_t capacity) {
+        return roundUp(std::max<std::size_t>(capacity, 64));
+    }
+
+    // Drops the oldest records until [head, head + size) no longer overlaps them.
+    void makeRoom(std::uint64_t head, std::uint64_t size) {
+        std::uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        while (head + size - tail > header_->capacity) {
+            MmapRecordHeader record;
+            std::memcpy(&record, data_ + tail % header_->capacity, sizeof(record));
+            tail += roundUp(sizeof(MmapRecordHeader) + record.payload_size);
+        }
+        header_->tail.store(tail, std::memory_order_release);
+    }
+
+    void store(std::uint64_t position, std::uint16_t kind, std::uint64_t payload_size, std::string_view payload) {
+        MmapRecordHeader record{static_cast<std::uint32_t>(payload_size), kind, 0};
+        char* at = data_ + position % header_->capacity;
+        std::memcpy(at, &record, sizeof(record));
+        if (!payload.empty()) {
+            std::memcpy(at + sizeof(record), payload.data(), payload.size());
+        }
+    }
+};
+
+// Read-only view of a ring file for offline dumping. Reading a ring that is
+// still being written is best effort: records overwritten during the walk are
+// skipped by re-checking tail.
+class MmapRingReader {
+public:
+    explicit MmapRingReader(const std::filesystem::path& filepath)
+    : mapping_(filepath, 0, false), header_(reinterpret_cast<const MmapRingHeader*>(mapping_.data())) {
+        if (std::memcmp(header_->magic, MmapRingHeader::kMagic, sizeof(header_->magic)) != 0
+            || header_->version != MmapRingHeader::kVersion
+            || mapping_.size() < header_->header_size + header_->capacity) {
+            throw std::system_error(EINVAL, std::generic_category(), "not a ring file: " + filepath.string());
+        }
+        data_ = mapping_.data() + header_->header_size;
+    }
+
+    std::uint64_t records() const {
+        return header_->records.load(std::memory_order_relaxed);
+    }
+
+    // Calls visit(kind, payload) for every record from oldest to newest.
+    template <typename Visit>
+    void forEach(Visit visit) const {
+        std::uint64_t capacity = header_->capacity;
+        std::uint64_t head = header_->head.load(std::memory_order_acquire);
+        std::uint64_t position = header_->tail.load(std::memory_order_acquire);
+        while (position < head) {
+            MmapRecordHeader record;
+            std::memcpy(&record, data_ + position % capacity, sizeof(record));
+            std::uint64_t size = (sizeof(MmapRecordHeader) + record.payload_size + 7) & ~std::uint64_t{7};
+            if (size > capacity - position % capacity) {
+                break;
+            }
+            if (record.kind != MmapRecordHeader::kPadding) {
+                visit(record.kind, std::string_view(data_ + position % capacity + sizeof(record), record.payload_size));
+            }
+            position += size;
+            position = std::max(position, header_->tail.load(std::memory_order_acquire));
+        }
+    }
+
+private:
+    MmapMapping mapping_;
+    const MmapRingHeader* header_;
+    const char* data_ = nullptr;
+};
+
+// Drop-in alternative to ErrorHandler that appends errors into a fixed-size,
+// crash-survivable ring file; dump it with error_ring_dump.
+class MmapErrorHandler final : public LogMessageHandler {
+public:
+    static constexpr LogMessageType kLogMessageType = LogMessageType::Error;
+    static constexpr std::size_t kDefaultCapacity = 4 * 1024 * 1024;
+
+    explicit MmapErrorHandler(const std::filesystem::path& filepath, std::size_t capacity = kDefaultCapacity)
+    : LogMessageHandler(kLogMessageType), ring_(filepath, capacity) {
+    }
+
+    void flush() {
+        ring_.sync();
+    }
+
+private:
+    mutable MmapRingWriter ring_;
+
+    void operate(const LogMessage& log) const override {
+        ring_.append(static_cast<std::uint16_t>(log.type()), renderText(log));
+    }
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+#include "log_message_handler.h"
+
+namespace detail {
+
+inline std::int64_t steadyNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace detail
+
+// Token-bucket limiter to insert in front of a sink. For each claimed type it
+// lets up to `burst` messages through at once and `messages_per_second` on
+// average after that; messages over the limit are claimed here and dropped,
+// the rest continue down the chain. The bucket is kept as a theoretical
+// arrival time in one atomic per type (GCRA), so the fast path is a load and
+// a compare-and-swap.
+//
+// Limiting relies on the first claiming handler being the only one to see a
+// message. In a broadcast chain every claiming handler operates, so the sinks
+// behind the limiter still receive everything and dropped() only counts.
+class RateLimitHandler final : public MultiTypeHandler {
+public:
+    // Throws std::invalid_argument unless messages_per_second is positive and
+    // at least one per 31 years.
+    RateLimitHandler(LogMessageTypeMask types, double messages_per_second, std::size_t burst)
+    : MultiTypeHandler(types),
+      interval_ns_(intervalNanos(messages_per_second)),
+      tolerance_ns_(static_cast<std::int64_t>(
+          std::min(static_cast<double>(interval_ns_) * static_cast<double>(std::max<std::size_t>(burst, 1) - 1),
+                   kMaxNanos))) {
+        setFilter(&RateLimitHandler::overLimit);
+    }
+
+    std::uint64_t dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Keeps arrival times far from overflowing an int64.
+    static constexpr double kMaxNanos = 1e18;
+
+    std::int64_t interval_ns_;
+    std::int64_t tolerance_ns_;
+    mutable std::array<std::atomic<std::int64_t>, kLogMessageTypeCount> arrival_{};
+    mutable std::atomic<std::uint64_t> dropped_{0};
+
+    static std::int64_t intervalNanos(double messages_per_second) {
+        if (!(messages_per_second > 0) || 1e9 / messages_per_second > kMaxNanos) {
+            throw std::invalid_argument("RateLimitHandler needs a positive messages_per_second");
+        }
+        return static_cast<std::int64_t>(1e9 / messages_per_second);
+    }
+
+    static bool overLimit(const LogMessageHandler& self, const LogMessage& log) {
+        const auto& limiter = static_cast<const RateLimitHandler&>(self);
+        std::atomic<std::int64_t>& arrival = limiter.arrival_[static_cast<std::size_t>(log.type())];
+        std::int64_t now = detail::steadyNanos();
+        std::int64_t expected = arrival.load(std::memory_order_relaxed);
+        for (;;) {
+            std::int64_t start = std::max(expected, now);
+            if (start - now > limiter.tolerance_ns_) {
+                return true;
+            }
+            if (arrival.compare_exchange_weak(expected, start + limiter.interval_ns_, std::memory_order_relaxed)) {
+                return false;
+            }
+        }
+    }
+
+    void operate(const LogMessage&) const override {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Collapses runs of identical messages. For each claimed type, a message equal
+// to the previous one within `window` is claimed here and counted instead of
+// being passed on. When a different message arrives, or the window has
+// expired, "last message repeated N times" is sent down the chain ahead of
+// it; flush() sends any pending summary. Summaries go down with tryHandle(),
+// whichever way the message that ended the run came in, so they never throw;
+// those no handler takes are counted. The state is a few atomics per type,
+// so under contention the counts are approximate but never block. As with
+// RateLimitHandler, a broadcast chain passes repeats to the later sinks too.
+class DedupHandler final : public MultiTypeHandler {
+public:
+    DedupHandler(LogMessageTypeMask types, std::chrono::milliseconds window)
+    : MultiTypeHandler(types),
+      window_ns_(std::chrono::duration_cast<std::chrono::nanoseconds>(window).count()) {
+        setFilter(&DedupHandler::isRepeat);
+    }
+
+    void flush() {
+        for (std::size_t type = 0; type < kLogMessageTypeCount; ++type) {
+            summarize(static_cast<LogMessageType>(type), states_[type].repeats.exchange(0));
+        }
+    }
+    std::uint64_t suppressed() const {
+        return suppressed_.load(std::memory_order_relaxed);
+    }
+    // Summaries the rest of the chain did not handle.
+    std::uint64_t unhandledSummaries() const {
+        return unhandled_summaries_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct State {
+        std::atomic<std::uint64_t> hash{0};
+        std::atomic<std::int64_t> window_start{0};
+        std::atomic<std::uint64_t> repeats{0};
+    };
+
+    std::int64_t window_ns_;
+    mutable std::array<State, kLogMessageTypeCount> states_;
+    mutable std::atomic<std::uint64_t> suppressed_{0};
+    mutable std::atomic<std::uint64_t> unhandled_summaries_{0};
+
+    // FNV-1a over the text and, for lazy messages, the positional arguments.
+    static std::uint64_t hashOf(const LogMessage& log) {
+        std::uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](std::string_view bytes) {
+            for (char c : bytes) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            }
+        };
+        mix(log.message());
+        if (log.lazy()) {
+            log.forEachField([&](const LogField& field) {
+                switch (field.kind) {
+                case LogFieldKind::String:
+                    mix(field.string_value);
+                    break;
+                case LogFieldKind::Bool:
+                    mix(field.bool_value ? "1" : "0");
+                    break;
+                default:
+                    // Int, UInt and Double share the same eight bytes.
+                    mix(std::string_view(reinterpret_cast<const char*>(&field.uint_value), sizeof(field.uint_value)));
+                    break;
+                }
+            });
+        }
+        return hash | 1;
+    }
+
+    static bool isRepeat(const LogMessageHandler& self, const LogMessage& log) {
+        const auto& dedup = static_cast<const DedupHandler&>(self);
+        State& state = dedup.states_[static_cast<std::size_t>(log.type())];
+        std::uint64_t hash = hashOf(log);
+        std::int64_t now = detail::steadyNanos();
+        if (state.hash.load(std::memory_order_relaxed) == hash
+            && now - state.window_start.load(std::memory_order_relaxed) < dedup.window_ns_) {
+            // Counted while routing rather than in operate(), so the summary
+            // is complete when the next message of a batch ends the run.
+            state.repeats.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        state.hash.store(hash, std::memory_order_relaxed);
+        state.window_start.store(now, std::memory_order_relaxed);
+        dedup.summarize(log.type(), state.repeats.exchange(0, std::memory_order_relaxed));
+        return false;
+    }
+
+    void summarize(LogMessageType type, std::uint64_t repeats) const {
+        if (repeats > 0 && nextHandler()) {
+            HandleStatus status =
+                nextHandler()->tryHandle(LogMessage::lazy(type, "last message repeated {} times", repeats));
+            if (status == HandleStatus::Unhandled) {
+                unhandled_summaries_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void operate(const LogMessage&) const override {
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "log_message.h"
+#include "log_message_handler.h"
+
+namespace detail {
+
+template <typename Handler, typename = void>
+struct HasStaticType : std::false_type {};
+
+template <typename Handler>
+struct HasStaticType<Handler, std::void_t<decltype(Handler::kLogMessageType)>> : std::true_type {};
+
+template <typename... Handlers>
+class StaticChainNode;
+
+template <>
+class StaticChainNode<> {
+public:
+    void handle(const LogMessage&) const {
+    }
+};
+
+template <typename Handler, typename... Rest>
+class StaticChainNode<Handler, Rest...> {
+public:
+    StaticChainNode() = default;
+    template <typename Args, typename... RestArgs>
+    explicit StaticChainNode(Args&& args, RestArgs&&... rest_args)
+    : handler_(std::make_from_tuple<Handler>(std::forward<Args>(args))),
+      rest_(std::forward<RestArgs>(rest_args)...) {
+    }
+
+    void handle(const LogMessage& log) const {
+        if (claims(log) && HandlerAccess::accepts(handler_, log)) {
+            HandlerAccess::operate(handler_, log);
+        } else {
+            rest_.handle(log);
+        }
+    }
+
+    template <typename T>
+    T& get() {
+        if constexpr (std::is_same_v<T, Handler>) {
+            return handler_;
+        } else {
+            return rest_.template get<T>();
+        }
+    }
+
+private:
+    Handler handler_;
+    StaticChainNode<Rest...> rest_;
+
+    bool claims(const LogMessage& log) const {
+        if constexpr (HasStaticType<Handler>::value) {
+            return log.type() == Handler::kLogMessageType;
+        } else {
+            return (handler_.logMessageTypes() & logMessageTypeMask(log.type())) != 0;
+        }
+    }
+};
+
+}  // namespace detail
+
+// Compile-time counterpart of a LogMessageHandler chain. A handler that exposes
+// a static constexpr kLogMessageType is matched by a constant comparison, which
+// the compiler folds into a switch; one claiming several types (BinaryLogHandler,
+// RateLimitHandler, DedupHandler) is matched by its mask. A predicate or filter
+// still applies, and operate() is called directly for final handlers.
+// First-match semantics follow the template argument order. There are no links,
+// so anything a handler passes to nextHandler(), such as a dedup summary, is
+// dropped.
+//
+// Handlers are default-constructed, or built from one argument tuple each:
+//     StaticChain<FatalErrorHandler, ErrorHandler> chain(std::tuple<>(), std::make_tuple(path));
+template <typename... Handlers>
+class StaticChain {
+public:
+    StaticChain() = default;
+    template <typename... ArgTuples,
+              typename = std::enable_if_t<sizeof...(ArgTuples) == sizeof...(Handlers)>>
+    explicit StaticChain(ArgTuples&&... args)
+    : chain_(std::forward<ArgTuples>(args)...) {
+    }
+
+    void handle(const LogMessage& log) const {
+        chain_.handle(log);
+    }
+
+    template <typename T>
+    T& get() {
+        return chain_.template get<T>();
+    }
+
+private:
+    detail::StaticChainNode<Handlers...> chain_;
+};
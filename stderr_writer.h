@@ -0,0 +1,89 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "flush_policy.h"
+#include "thread_buffers.h"
+
+// Stages whole lines for stderr in per-thread buffers, so threads logging
+// warnings neither share a buffer nor go through std::cerr and its locale
+// machinery. A buffer is written straight to fd 2 with write(2) when its
+// FlushPolicy says so, under a process-wide lock held for the whole buffer,
+// so lines never interleave. As with BufferedFileSink, lines keep their order
+// within a thread but not across threads.
+class StderrWriter {
+public:
+    explicit StderrWriter(FlushPolicy policy) : policy_(policy), buffers_(policy.max_buffered_bytes + 256) {
+        if (policy_.timerPeriod().count() > 0 || policy_.flush_on_shutdown) {
+            scheduler_id_ = FlushScheduler::instance().add([this] { flush(); }, policy_.timerPeriod(),
+                                                           policy_.flush_on_shutdown);
+        }
+    }
+    StderrWriter(const StderrWriter&) = delete;
+    StderrWriter& operator=(const StderrWriter&) = delete;
+    ~StderrWriter() {
+        if (scheduler_id_ != 0) {
+            FlushScheduler::instance().remove(scheduler_id_);
+        }
+        if (policy_.flush_on_shutdown) {
+            flush();
+        }
+    }
+
+    // lines must end with '\n'.
+    void append(std::string_view lines, bool flush_now = false) {
+        detail::ThreadBuffer& buffer = buffers_.local();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.touch();
+        buffer.data.append(lines);
+        if (flush_now || buffer.due(policy_)) {
+            writeOut(buffer.data);
+        }
+    }
+    void flush() {
+        buffers_.forEach([](detail::ThreadBuffer& buffer) { writeOut(buffer.data); });
+    }
+    const FlushPolicy& policy() const {
+        return policy_;
+    }
+
+private:
+    FlushPolicy policy_;
+    detail::ThreadBuffers buffers_;
+    FlushScheduler::Id scheduler_id_ = 0;
+
+    // One write(2) per buffer unless the kernel takes it in parts (pipes
+    // beyond PIPE_BUF); the lock keeps the parts together either way.
+    static void writeOut(std::string& data) {
+        if (data.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(fdMutex());
+            std::string_view rest = data;
+            while (!rest.empty()) {
+                ssize_t written = ::write(STDERR_FILENO, rest.data(), rest.size());
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                rest.remove_prefix(static_cast<std::size_t>(written));
+            }
+        }
+        data.clear();
+    }
+
+    // Never destroyed, so the exit-time flush from FlushScheduler can still take it.
+    static std::mutex& fdMutex() {
+        static std::mutex* mutex = new std::mutex;
+        return *mutex;
+    }
+};
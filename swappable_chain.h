@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "handler_chain.h"
+#include "log_message_handler.h"
+#include "thread_slots.h"
+
+// A chain that can be replaced while other threads log through it. swap()
+// publishes a new, fully built HandlerChain with one atomic exchange, then
+// waits out a grace period: every handle() that might still be walking the
+// old chain has returned once each reader slot is idle or has moved to the
+// new epoch, so the old chain is destroyed with no reader inside it.
+//
+// Readers never lock and only write their own slot: handle() announces the
+// current epoch in the calling thread's slot (a cache line of its own), loads
+// the chain pointer, and clears the slot on the way out. Calls may nest, e.g. a
+// handler logging through the same SwappableChain, but swap() must not be
+// called from inside handle() on the same chain, as it would wait for itself.
+class SwappableChain {
+public:
+    explicit SwappableChain(HandlerChain chain) : current_(new HandlerChain(std::move(chain))) {
+    }
+    SwappableChain(const SwappableChain&) = delete;
+    SwappableChain& operator=(const SwappableChain&) = delete;
+    // No handle() may be running or start once destruction begins.
+    ~SwappableChain() {
+        delete current_.load(std::memory_order_relaxed);
+    }
+
+    // Compile next first if it should run compiled. Swaps are serialized.
+    void swap(HandlerChain next) {
+        std::unique_ptr<HandlerChain> old;
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        old.reset(current_.exchange(new HandlerChain(std::move(next))));
+        std::uint64_t epoch = epoch_.fetch_add(1) + 1;
+        // Slots are only freed with this object, so they can be polled without
+        // the lock; a slot adopted by a new thread meanwhile shows 0 or the new
+        // epoch.
+        std::vector<ReaderSlot*> slots;
+        slots_.forEach([&slots](ReaderSlot& slot) { slots.push_back(&slot); });
+        for (ReaderSlot* slot : slots) {
+            for (;;) {
+                std::uint64_t seen = slot->epoch.load();
+                if (seen == 0 || seen >= epoch) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+        swaps_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void handle(const LogMessage& log) {
+        ReadGuard guard(*this);
+        guard.chain().head().handle(log);
+    }
+    void handle(const std::vector<LogMessage>& logs) {
+        ReadGuard guard(*this);
+        guard.chain().head().handle(logs);
+    }
+    HandleStatus tryHandle(const LogMessage& log) {
+        ReadGuard guard(*this);
+        return guard.chain().head().tryHandle(log);
+    }
+    std::uint64_t swaps() const {
+        return swaps_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(64) ReaderSlot {
+        // 0 while the owning thread is outside handle(), otherwise the epoch
+        // it saw on entry.
+        std::atomic<std::uint64_t> epoch{0};
+        // Nesting depth; only the owning thread touches it.
+        unsigned depth = 0;
+    };
+
+    // Every access to current_, epoch_ and the slots is sequentially
+    // consistent: a reader's slot store is ordered before its load of the
+    // chain, and swap()'s exchange before its scan of the slots, so a reader
+    // that can still see the old chain is always seen by the scan.
+    class ReadGuard {
+    public:
+        explicit ReadGuard(SwappableChain& owner) : slot_(owner.slots_.local([](ReaderSlot&) {})) {
+            if (slot_.depth++ == 0) {
+                slot_.epoch.store(owner.epoch_.load());
+            }
+            chain_ = owner.current_.load();
+        }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ~ReadGuard() {
+            if (--slot_.depth == 0) {
+                slot_.epoch.store(0, std::memory_order_release);
+            }
+        }
+
+        HandlerChain& chain() const {
+            return *chain_;
+        }
+
+    private:
+        ReaderSlot& slot_;
+        HandlerChain* chain_;
+    };
+
+    std::atomic<HandlerChain*> current_;
+    std::atomic<std::uint64_t> epoch_{1};
+    std::atomic<std::uint64_t> swaps_{0};
+    std::mutex writer_mutex_;
+    detail::ThreadSlots<ReaderSlot> slots_;
+};
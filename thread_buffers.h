@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+#include "flush_policy.h"
+#include "thread_slots.h"
+
+namespace detail {
+
+// Whole lines staged by one thread for one sink. The mutex is only contended
+// when a flush from another thread drains the buffer.
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::string data;
+    std::chrono::steady_clock::time_point oldest;
+
+    // Call before appending, to start the age clock of an empty buffer.
+    void touch() {
+        if (data.empty()) {
+            oldest = std::chrono::steady_clock::now();
+        }
+    }
+    bool due(const FlushPolicy& policy) const {
+        return data.size() >= policy.max_buffered_bytes
+            || (policy.max_delay.count() > 0 && std::chrono::steady_clock::now() - oldest >= policy.max_delay);
+    }
+};
+
+// The per-thread buffers of one sink: local() finds or creates the calling
+// thread's buffer, forEach() visits all of them for a flush. A thread that
+// exits leaves its lines to the next flush and its buffer to the next thread
+// that logs to the sink.
+class ThreadBuffers {
+public:
+    explicit ThreadBuffers(std::size_t reserve) : reserve_(reserve) {
+    }
+
+    ThreadBuffer& local() {
+        return slots_.local([this](ThreadBuffer& buffer) { buffer.data.reserve(reserve_); });
+    }
+    // Calls visit on every buffer with its lock held.
+    template <typename Visit>
+    void forEach(Visit visit) {
+        slots_.forEach([&visit](ThreadBuffer& buffer) {
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            visit(buffer);
+        });
+    }
+
+private:
+    std::size_t reserve_;
+    ThreadSlots<ThreadBuffer> slots_;
+};
+
+}  // namespace detail
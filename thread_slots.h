@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace detail {
+
+// Per-thread state of one owner (a sink's buffers, a chain's reader slots).
+// local() returns the calling thread's slot, forEach() visits every slot.
+//
+// When a thread exits, its slots go back to their owners for the next thread
+// that needs one, so an owner holds as many slots as it ever had threads at
+// once, not one per thread it has seen. Slots are only freed with their owner,
+// so a pointer taken under the lock stays valid while the owner lives. Each
+// thread's cache of owners is keyed by id, so a new owner at the address of a
+// destroyed one is never confused with it, and entries of destroyed owners
+// are dropped on the next cache miss.
+template <typename T>
+class ThreadSlots {
+public:
+    ThreadSlots() : registry_(std::make_shared<Registry>()), id_(nextId()) {
+    }
+    ThreadSlots(const ThreadSlots&) = delete;
+    ThreadSlots& operator=(const ThreadSlots&) = delete;
+
+    // init runs once on a newly allocated slot, not when a slot is reused.
+    template <typename Init>
+    T& local(Init init) {
+        LastHit& last = lastHit();
+        if (last.owner_id == id_) {
+            return *last.value;
+        }
+        T& value = localSlow(init);
+        last = LastHit{id_, &value};
+        return value;
+    }
+    // Calls visit on every slot, in use or not, with the registry locked.
+    template <typename Visit>
+    void forEach(Visit visit) {
+        std::lock_guard<std::mutex> lock(registry_->mutex);
+        for (const auto& slot : registry_->slots) {
+            visit(slot->value);
+        }
+    }
+
+private:
+    struct Slot {
+        T value;
+        bool in_use = false;
+    };
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Slot>> slots;
+    };
+    struct LastHit {
+        std::uint64_t owner_id = 0;
+        T* value = nullptr;
+    };
+    struct CacheEntry {
+        std::uint64_t owner_id;
+        std::weak_ptr<Registry> registry;
+        Slot* slot;
+    };
+    // Returns the thread's slots to their live owners when the thread exits.
+    struct ThreadCache {
+        std::vector<CacheEntry> entries;
+
+        ~ThreadCache() {
+            for (const CacheEntry& entry : entries) {
+                if (std::shared_ptr<Registry> registry = entry.registry.lock()) {
+                    std::lock_guard<std::mutex> lock(registry->mutex);
+                    entry.slot->in_use = false;
+                }
+            }
+            lastHit() = LastHit{};
+        }
+    };
+
+    std::shared_ptr<Registry> registry_;
+    std::uint64_t id_;
+
+    static std::uint64_t nextId() {
+        static std::atomic<std::uint64_t> next_id{1};
+        return next_id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static LastHit& lastHit() {
+        thread_local LastHit last;
+        return last;
+    }
+    static ThreadCache& threadCache() {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    template <typename Init>
+    T& localSlow(Init init) {
+        std::vector<CacheEntry>& entries = threadCache().entries;
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [](const CacheEntry& entry) { return entry.registry.expired(); }),
+                      entries.end());
+        for (const CacheEntry& entry : entries) {
+            if (entry.owner_id == id_) {
+                return entry.slot->value;
+            }
+        }
+        Slot* slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(registry_->mutex);
+            for (const auto& candidate : registry_->slots) {
+                if (!candidate->in_use) {
+                    slot = candidate.get();
+                    break;
+                }
+            }
+            if (!slot) {
+                registry_->slots.push_back(std::make_unique<Slot>());
+                slot = registry_->slots.back().get();
+                init(slot->value);
+            }
+            slot->in_use = true;
+        }
+        entries.push_back(CacheEntry{id_, registry_, slot});
+        return slot->value;
+    }
+};
+
+}  // namespace detail
@@ -0,0 +1,43 @@
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string_view>
+
+#include "mmap_error_handler.h"
+
+namespace {
+
+const char* kindName(std::uint16_t kind) {
+    switch (static_cast<LogMessageType>(kind)) {
+    case LogMessageType::Warning:
+        return "Warning";
+    case LogMessageType::Error:
+        return "Error";
+    case LogMessageType::FatalError:
+        return "FatalError";
+    case LogMessageType::UnknownMessage:
+        return "UnknownMessage";
+    }
+    return "?";
+}
+
+}  // namespace
+
+// Usage: error_ring_dump <ring-file>
+// Prints every record of an MmapErrorHandler ring from oldest to newest.
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <ring-file>" << std::endl;
+        return 2;
+    }
+    try {
+        MmapRingReader reader(argv[1]);
+        reader.forEach([](std::uint16_t kind, std::string_view payload) {
+            std::cout << '[' << kindName(kind) << "] " << payload << '\n';
+        });
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "binary_log.h"
+#include "log_format.h"
+
+namespace {
+
+const char* typeName(LogMessageType type) {
+    switch (type) {
+    case LogMessageType::Warning:
+        return "Warning";
+    case LogMessageType::Error:
+        return "Error";
+    case LogMessageType::FatalError:
+        return "FatalError";
+    case LogMessageType::UnknownMessage:
+        return "UnknownMessage";
+    }
+    return "?";
+}
+
+}  // namespace
+
+// Usage: logdecode <binary-log>
+// Renders a BinaryLogHandler file as text, one record per line.
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <binary-log>" << std::endl;
+        return 2;
+    }
+    std::ifstream ifs(argv[1], std::ios::binary);
+    if (!ifs.is_open()) {
+        std::cerr << "cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    try {
+        std::string data{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+        BinaryLogDecoder decoder(std::move(data));
+        std::string line;
+        decoder.forEach([&line](const LogMessage& log) {
+            line.assign("[");
+            line.append(typeName(log.type()));
+            line.append("] ");
+            appendText(line, log);
+            line.push_back('\n');
+            std::cout << line;
+        });
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}